@@ -2,6 +2,7 @@
 
 #include <csnode/Blockchain.hpp>
 #include <mutex>
+#include <unordered_map>
 
 #include <API.h>
 #include <Solver/ISolver.hpp>
@@ -41,10 +42,14 @@ struct APIHandlerInterface
 
 using namespace ::apache;
 
+class SessionIO;
+
 class APIHandler : public APIHandlerInterface
 {
   public:
-    APIHandler(Credits::BlockChain& blockchain, Credits::ISolver& _solver);
+    APIHandler(Credits::BlockChain& blockchain,
+               Credits::ISolver& _solver,
+               SessionIO* net);
     ~APIHandler() override = default;
 
     void BalanceGet(api::BalanceGetResult& _return,
@@ -78,6 +83,8 @@ class APIHandler : public APIHandlerInterface
 
     void NodesInfoGet(api::NodesInfoGetResult& _return) override;
 
+    void NetworkStatsGet(api::NetworkStatsGetResult& _return) override;
+
     void SmartContractGet(api::SmartContractGetResult& _return,
                           const api::Address& address) override;
 
@@ -104,6 +111,8 @@ class APIHandler : public APIHandlerInterface
 
     Credits::ISolver& solver;
 
+    SessionIO* net;
+
     csstats::csstats stats;
 
     ::apache::thrift::stdcxx::shared_ptr<
@@ -124,7 +133,8 @@ class APIHandler : public APIHandlerInterface
     std::map<decltype(api::SmartContract::address), csdb::TransactionID>
       smart_origin, smart_state;
 
-    std::map<csdb::Address, std::list<csdb::TransactionID>> deployed_by_creator;
+    std::unordered_map<csdb::Address, std::list<csdb::TransactionID>>
+      deployed_by_creator;
 
     csdb::PoolHash last_seen_contract_block;
 
@@ -136,5 +146,5 @@ class APIHandler : public APIHandlerInterface
 
     void update_smart_caches();
 
-    std::map<csdb::PoolHash, api::Pool> poolCache;
+    std::unordered_map<csdb::PoolHash, api::Pool> poolCache;
 };
\ No newline at end of file
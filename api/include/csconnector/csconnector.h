@@ -29,7 +29,7 @@ namespace csconnector {
     class csconnector {
     public:
 
-        csconnector(Credits::BlockChain &m_blockchain, Credits::ISolver* solver, const Config &config = Config{});
+        csconnector(Credits::BlockChain &m_blockchain, Credits::ISolver* solver, SessionIO* net, const Config &config = Config{});
         ~csconnector();
 
 
@@ -14,10 +14,12 @@
 
 #include <algorithm>
 #include <cassert>
+#include <limits>
 
 #include <api_types.h>
 
 #include <net/Logger.hpp>
+#include <net/SessionIO.hpp>
 
 #include <iomanip>
 
@@ -26,9 +28,11 @@
 using namespace api;
 
 APIHandler::APIHandler(Credits::BlockChain& blockchain,
-                       Credits::ISolver& _solver)
+                       Credits::ISolver& _solver,
+                       SessionIO* _net)
   : s_blockchain(blockchain)
   , solver(_solver)
+  , net(_net)
   , stats(blockchain)
   , executor_transport(new thrift::transport::TBufferedTransport(
       thrift::stdcxx::make_shared<thrift::transport::TSocket>("localhost",
@@ -194,8 +198,13 @@ APIHandler::convertPool(const csdb::Pool& pool)
 api::Pool
 APIHandler::convertPool(const csdb::PoolHash& poolHash)
 {
-    const csdb::Pool& pool = s_blockchain.loadBlock(poolHash);
-    return convertPool(pool);
+    // The header carries everything but the transactions themselves
+    size_t transactionsCount = 0;
+    const csdb::Pool pool =
+      s_blockchain.loadBlockMeta(poolHash, transactionsCount);
+    api::Pool result = convertPool(pool);
+    result.transactionsCount = (int32_t)transactionsCount;
+    return result;
 }
 
 api::Transactions
@@ -263,34 +272,11 @@ APIHandler::TransactionsGet(TransactionsGetResult& _return,
         addr = csdb::Address::from_string(address);
 
     std::vector<csdb::Transaction> transactions;
-    csdb::Pool curr = s_blockchain.loadBlock(s_blockchain.getLastHash());
-
-    while (curr.is_valid()) {
-        if (curr.transactions_count()) {
-            auto curIdx = static_cast<csdb::TransactionID::sequence_t>(
-              curr.transactions_count() - 1);
-
-            while (true) {
-                auto trans = curr.transaction(curIdx);
-                if (trans.target() == addr || trans.source() == addr) {
-                    if (offset == 0)
-                        transactions.push_back(trans);
-                    else
-                        --offset;
-                }
-
-                if (transactions.size() == limit)
-                    break;
-
-                if (curIdx == 0)
-                    break;
-                --curIdx;
-            }
-        }
-
-        if (transactions.size() == limit)
-            break;
-        curr = s_blockchain.loadBlock(curr.previous_hash());
+    if (offset >= 0) {
+        const size_t count = limit < 0 ? std::numeric_limits<size_t>::max()
+                                       : static_cast<size_t>(limit);
+        transactions = s_blockchain.getTransactions(
+          addr, static_cast<size_t>(offset), count);
     }
 
     _return.transactions = convertTransactions(transactions);
@@ -502,39 +488,31 @@ APIHandler::PoolListGet(api::PoolListGetResult& _return,
             const int64_t const_limit)
 {
 
-    if (offset > 100)
-        const_cast<int64_t&>(offset) = 100;
-    if (const_limit > 100)
-        const_cast<int64_t&>(const_limit) = 100;
+    if (offset < 0 || const_limit <= 0)
+        return;
 
-    _return.pools.reserve(const_limit);
+    const uint64_t limit =
+      static_cast<uint64_t>(std::min(const_limit, static_cast<int64_t>(100)));
+    _return.pools.reserve(limit);
 
-    csdb::PoolHash hash = s_blockchain.getLastHash();
+    size_t cnt;
+    const csdb::Pool last =
+      s_blockchain.loadBlockMeta(s_blockchain.getLastHash(), cnt);
+    if (!last.is_valid() || static_cast<uint64_t>(offset) > last.sequence())
+        return;
 
-    size_t lastCount = 0;
-    csdb::Pool pool; 
-    uint64_t sequence = s_blockchain.getSize();
+    // Pools are looked up by sequence, so the page depth does not matter
+    const uint64_t upper = last.sequence() - static_cast<uint64_t>(offset);
+    const uint64_t count = std::min(limit, upper + 1);
+    for (uint64_t i = 0; i < count; ++i) {
+        const csdb::PoolHash hash = s_blockchain.getHashBySequence(upper - i);
+        if (hash.is_empty())
+            break;
 
-    const uint64_t lower =
-      sequence - std::min(sequence, (uint64_t)(offset + const_limit));
-    for (uint64_t it = sequence; it > lower; --it) {
         auto cch = poolCache.find(hash);
-
-        if (cch == poolCache.end()) {
-            pool = s_blockchain.loadBlock(hash);
-            api::Pool apiPool = convertPool(pool);
-
-            if (it <= sequence - std::min(sequence, (uint64_t)offset)) {
-                _return.pools.push_back(apiPool);
-            }
-            lastCount = 0;
-
-            poolCache.insert(cch, std::make_pair(hash, apiPool));
-            hash = pool.previous_hash();
-        } else {
-            _return.pools.push_back(cch->second);
-            hash = csdb::PoolHash::from_string(cch->second.prevHash);
-        }
+        if (cch == poolCache.end())
+            cch = poolCache.insert(cch, std::make_pair(hash, convertPool(hash)));
+        _return.pools.push_back(cch->second);
     }
 }
 
@@ -564,12 +542,8 @@ APIHandler::PoolInfoGet(PoolInfoGetResult& _return,
     Log("PoolInfoGet");
 
     const csdb::PoolHash poolHash = csdb::PoolHash::from_string(hash);
-    const csdb::Pool pool = s_blockchain.loadBlock(poolHash);
-    _return.isFound = pool.is_valid();
-
-    if (_return.isFound) {
-        _return.pool = convertPool(poolHash);
-    }
+    _return.pool = convertPool(poolHash);
+    _return.isFound = !_return.pool.hash.empty();
 
     SetResponseStatus(_return.status, APIRequestStatusType::SUCCESS);
 }
@@ -609,6 +583,38 @@ APIHandler::NodesInfoGet(api::NodesInfoGetResult& _return)
     SetResponseStatus(_return.status, APIRequestStatusType::NOT_IMPLEMENTED);
 }
 
+namespace {
+api::PeerRtt
+convertRtt(const std::string& address, const RttEstimator& rtt)
+{
+    api::PeerRtt result;
+    result.address = address;
+    result.srttUs = rtt.srtt().count();
+    result.rttVarUs = rtt.rttvar().count();
+    result.rtoUs = rtt.rto().count();
+    result.samples = rtt.samples();
+    return result;
+}
+} // namespace
+
+void
+APIHandler::NetworkStatsGet(api::NetworkStatsGetResult& _return)
+{
+    Log("NetworkStatsGet");
+
+    if (!net) {
+        SetResponseStatus(_return.status, APIRequestStatusType::FAILURE);
+        return;
+    }
+
+    _return.network = convertRtt(std::string(), net->getNetworkRtt());
+    for (auto& peer : net->getPeerRtt())
+        _return.peers.push_back(
+          convertRtt(peer.first.to_string(), peer.second));
+
+    SetResponseStatus(_return.status, APIRequestStatusType::SUCCESS);
+}
+
 
 void
 APIHandler::SmartContractGet(api::SmartContractGetResult& _return,
@@ -633,7 +639,8 @@ APIHandler::SmartContractGet(api::SmartContractGetResult& _return,
 void
 APIHandler::update_smart_caches()
 {
-    std::map<csdb::Address, std::list<csdb::TransactionID>::iterator> poss;
+    std::unordered_map<csdb::Address, std::list<csdb::TransactionID>::iterator>
+      poss;
     std::set<api::Address> state_updated;
     auto last_ph = s_blockchain.getLastHash();
     auto curr_ph = last_ph;
@@ -5,9 +5,9 @@ namespace csconnector {
 
     using namespace stdcxx;
 
-    csconnector::csconnector(Credits::BlockChain &m_blockchain, Credits::ISolver* solver, const Config &config)
+    csconnector::csconnector(Credits::BlockChain &m_blockchain, Credits::ISolver* solver, SessionIO* net, const Config &config)
 		: server(
-                    make_shared<APIProcessor>(make_shared<APIHandler>(m_blockchain, *solver)),
+                    make_shared<APIProcessor>(make_shared<APIHandler>(m_blockchain, *solver, net)),
                     make_shared<TServerSocket>(config.port),
                     make_shared<TBufferedTransportFactory>(),
                     make_shared<TBinaryProtocolFactory>())
@@ -45,26 +45,33 @@ csstats::collectStats(const Periods& periods)
 
         time_t timeMs = 0;
 
-        const csdb::Pool pool = blockchain.loadBlock(blockHash);
+        // Only the header is needed unless the pool falls into a period
+        size_t transactionsCount = 0;
+        const csdb::Pool meta =
+          blockchain.loadBlockMeta(blockHash, transactionsCount);
+        if (!meta.is_valid())
+            break;
 
         time_t timeSec = timeMs / 1000;
 
         auto now = std::chrono::system_clock::now();
         auto poolTime_t =
-          atoll(pool.user_field(0).value<std::string>().c_str()) / 1000;
+          atoll(meta.user_field(0).value<std::string>().c_str()) / 1000;
         auto poolTime = std::chrono::system_clock::from_time_t(poolTime_t);
 
         using Seconds = std::chrono::seconds;
         Seconds poolAgeSec =
           std::chrono::duration_cast<Seconds>(now - poolTime);
 
+        csdb::Pool pool;
         matchPeriod(
           periods, (Period)poolAgeSec.count(), [&](size_t periodIndex) {
               PeriodStats& periodStats = stats[periodIndex];
               periodStats.poolsCount++;
 
-              size_t transactionsCount = pool.transactions_count();
               periodStats.transactionsCount += transactionsCount;
+              if (transactionsCount && !pool.is_valid())
+                  pool = blockchain.loadBlock(blockHash);
               for (size_t i = 0; i < transactionsCount; ++i) {
                   const auto& transaction =
                     pool.transaction(csdb::TransactionID(pool.hash(), i));
@@ -83,7 +90,7 @@ csstats::collectStats(const Periods& periods)
               }
           });
 
-        blockHash = pool.previous_hash();
+        blockHash = meta.previous_hash();
     }
 
     auto finishTime = std::chrono::high_resolution_clock::now();
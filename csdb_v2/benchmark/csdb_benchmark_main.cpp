@@ -1,11 +1,66 @@
 #include <benchmark/benchmark.h>
 
-static void bench(benchmark::State &state)
+#include "csdb/address.h"
+#include "csdb/amount.h"
+#include "csdb/currency.h"
+#include "csdb/pool.h"
+#include "csdb/transaction.h"
+#include "csdb/user_field.h"
+
+#include "priv_crypto.h"
+
+namespace {
+
+::csdb::Address make_address(uint8_t last)
 {
+  ::csdb::internal::byte_array key(::csdb::priv::crypto::public_key_size, 0);
+  key.back() = last;
+  return ::csdb::Address::from_public_key(key);
+}
+
+// Binary of a pool with the given number of transactions, each with a comment
+::csdb::internal::byte_array make_pool(int64_t count)
+{
+  ::csdb::Pool pool{::csdb::PoolHash{}, 1};
+  const ::csdb::Address source = make_address(1);
+  const ::csdb::Address target = make_address(2);
+  for (int64_t i = 1; i <= count; ++i) {
+    ::csdb::Transaction t(source, target, ::csdb::Currency("CS"), ::csdb::Amount(static_cast<int32_t>(i)));
+    t.add_user_field(1, ::csdb::UserField("Comment"));
+    pool.add_transaction(t
+#ifdef CSDB_UNIT_TEST
+                         , true
+#endif
+                         );
+  }
+  pool.compose();
+  return pool.to_binary();
+}
+
+// Decodes the pool and frees it again
+void pool_decode(benchmark::State &state, bool use_arena)
+{
+  const ::csdb::internal::byte_array data = make_pool(state.range(0));
   for(auto _ : state)
   {
+    ::csdb::Pool pool = ::csdb::Pool::from_binary(data, use_arena);
+    benchmark::DoNotOptimize(pool);
   }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+} // namespace
+
+static void pool_decode_heap(benchmark::State &state)
+{
+  pool_decode(state, false);
+}
+BENCHMARK(pool_decode_heap)->Arg(10)->Arg(1000)->Arg(10000);
+
+static void pool_decode_arena(benchmark::State &state)
+{
+  pool_decode(state, true);
 }
-BENCHMARK(bench);
+BENCHMARK(pool_decode_arena)->Arg(10)->Arg(1000)->Arg(10000);
 
 BENCHMARK_MAIN();
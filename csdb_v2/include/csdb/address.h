@@ -7,9 +7,10 @@
 #ifndef _CREDITS_CSDB_ADDRESS_H_INCLUDED_
 #define _CREDITS_CSDB_ADDRESS_H_INCLUDED_
 
+#include <cstring>
+#include <functional>
 #include <string>
 
-#include "csdb/internal/shared_data.h"
 #include "csdb/internal/types.h"
 
 namespace csdb {
@@ -19,10 +20,19 @@ class obstream;
 class ibstream;
 } // namespace priv
 
+/**
+ * @brief Адрес кошелька
+ *
+ * Ключ хранится в самом объекте, поэтому копирование, сравнение и хеширование
+ * адреса не обращаются к куче.
+ */
 class Address
 {
-  SHARED_DATA_CLASS_DECLARE(Address)
 public:
+  static const size_t max_size = 32;
+
+  Address() noexcept;
+
   bool is_valid() const noexcept;
   ::std::string to_string() const noexcept;
   static Address from_string(const std::string &val);
@@ -47,6 +57,11 @@ private:
   bool get(::csdb::priv::ibstream&);
   friend class ::csdb::priv::obstream;
   friend class ::csdb::priv::ibstream;
+  friend struct ::std::hash<Address>;
+
+private:
+  uint8_t size_;
+  uint8_t data_[max_size];
 };
 
 inline bool Address::operator !=(const Address &other) const noexcept
@@ -56,4 +71,17 @@ inline bool Address::operator !=(const Address &other) const noexcept
 
 } // namespace csdb
 
+namespace std {
+
+template<>
+struct hash<::csdb::Address>
+{
+  size_t operator()(const ::csdb::Address &address) const noexcept
+  {
+    return ::csdb::internal::hash_bytes(address.data_, address.size_);
+  }
+};
+
+} // namespace std
+
 #endif // _CREDITS_CSDB_ADDRESS_H_INCLUDED_
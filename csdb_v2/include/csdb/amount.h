@@ -200,7 +200,7 @@ inline Amount& Amount::operator +=(const Amount& other) noexcept
 {
   integral_ += other.integral_;
   fraction_ += other.fraction_;
-  if (fraction_ > AMOUNT_MAX_FRACTION) {
+  if (fraction_ >= AMOUNT_MAX_FRACTION) {
     ++integral_;
     fraction_ -= AMOUNT_MAX_FRACTION;
   }
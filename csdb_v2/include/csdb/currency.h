@@ -2,7 +2,7 @@
 #ifndef _CREDITS_CSDB_CURRENCY_H_INCLUDED_
 #define _CREDITS_CSDB_CURRENCY_H_INCLUDED_
 
-#include "csdb/internal/shared_data.h"
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -13,10 +13,11 @@ class obstream;
 class ibstream;
 } // namespace priv
 
+//Short names fit into the string's inline buffer, so a currency is copied without allocation
 class Currency
 {
-  SHARED_DATA_CLASS_DECLARE(Currency)
 public:
+  Currency() = default;
   Currency(const std::string &name);
 
   bool is_valid() const noexcept;
@@ -31,10 +32,27 @@ private:
   bool get(::csdb::priv::ibstream&);
   friend class ::csdb::priv::obstream;
   friend class ::csdb::priv::ibstream;
+  friend struct ::std::hash<Currency>;
+
+private:
+  std::string name_;
 };
 
 typedef std::vector<Currency> CurrencyList;
 
 } // namespace csdb
 
+namespace std {
+
+template<>
+struct hash<::csdb::Currency>
+{
+  size_t operator()(const ::csdb::Currency &currency) const noexcept
+  {
+    return hash<string>()(currency.name_);
+  }
+};
+
+} // namespace std
+
 #endif // _CREDITS_CSDB_CURRENCY_H_INCLUDED_
@@ -9,24 +9,51 @@
 
 #include "shared_data.h"
 
+#include <cstddef>
 #include <utility>
 
 namespace csdb {
 namespace internal {
 
+class arena;
+
 class shared_data
 {
 public:
-  inline shared_data() : ref(0) {}
-  inline shared_data(const shared_data&) : ref(0) {}
+  inline shared_data() : ref(0), arena_(arena_of()) {}
+  inline shared_data(const shared_data&) : ref(0), arena_(arena_of()) {}
 
 private:
   shared_data(shared_data&&) = delete;
   shared_data &operator=(const shared_data&) = delete;
   shared_data &operator=(shared_data&&) = delete;
 
+public:
+  // Shared data created while a pool is decoded into an arena is placed there
+  static void* operator new(std::size_t size);
+  static void operator delete(void* ptr) noexcept;
+
+  // Destroys the data and frees its memory, or hands it back to the arena it came from
+  template <class T>
+  static void destroy(T* d) noexcept
+  {
+    arena* owner = d->arena_;
+    d->~T();
+    if (nullptr == owner) {
+      ::operator delete(d);
+    }
+    else {
+      release(owner);
+    }
+  }
+
+private:
+  static arena* arena_of() noexcept;
+  static void release(arena* owner) noexcept;
+
 public:
   mutable std::atomic<std::size_t> ref;
+  arena* const arena_;    // Null for data on the heap
 #ifdef CSDB_UNIT_TEST
   bool copy_semantic_used_ = false;
   bool move_semantic_used_ = false;
@@ -70,7 +97,7 @@ template <class T>
 inline shared_data_ptr<T>::~shared_data_ptr()
 {
   if (d && (0 == (--d->ref))) {
-    delete d;
+    shared_data::destroy(d);
   }
 }
 
@@ -88,7 +115,7 @@ inline shared_data_ptr<T> & shared_data_ptr<T>::operator=(const shared_data_ptr<
     T *old = d;
     d = o.d;
     if (old && (0 == (--old->ref))) {
-      delete old;
+      shared_data::destroy(old);
     }
   }
   return *this;
@@ -111,7 +138,7 @@ inline void shared_data_ptr<T>::detach()
     T *x = new T(*d);
     ++x->ref;
     if(0 == (--d->ref)) {
-      delete d;
+      shared_data::destroy(d);
     }
     d = x;
   }
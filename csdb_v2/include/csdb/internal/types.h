@@ -3,6 +3,7 @@
 #define _CREDITS_CSDB_TYPES_H_INCLUDED_
 
 #include <cinttypes>
+#include <cstddef>
 #include <vector>
 #include <string>
 
@@ -11,6 +12,23 @@ namespace internal {
 
 using byte_array = std::vector<std::uint8_t>;
 
+// One of the memory blocks a binary is split over, e.g. the fragments of a network message
+struct byte_span
+{
+  const void *data;
+  std::size_t size;
+};
+
+// FNV-1a over a short byte string, used by the std::hash specialisations
+inline std::size_t hash_bytes(const std::uint8_t *data, std::size_t size) noexcept
+{
+  std::uint64_t res = 14695981039346656037ULL;
+  for (std::size_t i = 0; i < size; ++i) {
+    res = (res ^ data[i]) * 1099511628211ULL;
+  }
+  return static_cast<std::size_t>(res);
+}
+
 } // namespace internal
 } // namespace csdb
 
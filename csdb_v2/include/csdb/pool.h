@@ -6,6 +6,7 @@
 #include <vector>
 #include <array>
 #include <string>
+#include <functional>
 
 #include "csdb/transaction.h"
 #include "csdb/storage.h"
@@ -23,11 +24,14 @@ class obstream;
 class ibstream;
 } // namespace priv
 
+//The hash is kept inside the object: copying, comparing and hashing it do not touch the heap
 class PoolHash
 {
-  SHARED_DATA_CLASS_DECLARE(PoolHash)
-
 public:
+  static const size_t max_size = 32;
+
+  PoolHash() noexcept;
+
   bool is_empty() const noexcept;
   size_t size() const noexcept;
   std::string to_string() const noexcept;
@@ -51,6 +55,11 @@ private:
   friend class ::csdb::priv::obstream;
   friend class ::csdb::priv::ibstream;
   friend class Storage;
+  friend struct ::std::hash<PoolHash>;
+
+private:
+  uint8_t size_;
+  uint8_t value_[max_size];
 };
 
 class Pool
@@ -63,10 +72,21 @@ public:
   Pool(PoolHash previous_hash, sequence_t sequence, Storage storage = Storage());
 
   static Pool from_binary(const ::csdb::internal::byte_array& data);
+
+  //Decodes the pool into an arena: the pool, its transactions and their fields share a few
+  //memory blocks, which are freed when the last object taken from the pool is gone
+  static Pool from_binary(const ::csdb::internal::byte_array& data, bool use_arena);
   static Pool meta_from_binary(const ::csdb::internal::byte_array& data, size_t& cnt);
+
+  //Compact header kept by the storage next to the pool: previous hash, sequence,
+  //transaction count, binary size and user fields. The decoded pool has no transactions.
+  static Pool header_from_binary(const PoolHash& hash, const ::csdb::internal::byte_array& data, size_t& cnt);
+  ::csdb::internal::byte_array header_to_binary() const;
   static Pool load(PoolHash hash, Storage storage = Storage());
 
   static Pool from_byte_stream(const char* data, size_t size);
+  //Decodes a pool split over several memory blocks without joining them
+  static Pool from_byte_stream(const ::csdb::internal::byte_span* spans, size_t count);
   char* to_byte_stream(size_t& size);
 
   bool clear()  noexcept;
@@ -139,4 +159,17 @@ inline bool PoolHash::operator !=(const PoolHash &other) const noexcept
 
 } // namespace csdb
 
+namespace std {
+
+template<>
+struct hash<::csdb::PoolHash>
+{
+  size_t operator()(const ::csdb::PoolHash &hash) const noexcept
+  {
+    return ::csdb::internal::hash_bytes(hash.value_, hash.size_);
+  }
+};
+
+} // namespace std
+
 #endif // _CREDITS_CSDB_POOL_H_INCLUDED_
@@ -0,0 +1,43 @@
+#pragma once
+#ifndef _CREDITS_CSDB_POOL_VIEW_H_INCLUDED_
+#define _CREDITS_CSDB_POOL_VIEW_H_INCLUDED_
+
+#include <set>
+
+#include "csdb/pool.h"
+#include "csdb/transaction.h"
+#include "csdb/user_field.h"
+#include "csdb/internal/shared_data.h"
+#include "csdb/internal/types.h"
+
+namespace csdb {
+
+//Read-only view of a stored pool. Only the offsets of the transactions are found
+//when the view is built, each transaction is decoded when it is requested.
+class PoolView
+{
+  SHARED_DATA_CLASS_DECLARE(PoolView)
+
+public:
+  static PoolView from_binary(const PoolHash& hash, ::csdb::internal::byte_array data);
+
+  bool is_valid() const noexcept;
+  PoolHash hash() const noexcept;
+  PoolHash previous_hash() const noexcept;
+  Pool::sequence_t sequence() const noexcept;
+  size_t transactions_count() const noexcept;
+
+  //Decodes the transaction with the given index
+  Transaction transaction(size_t index) const;
+  Transaction transaction(TransactionID id) const;
+
+  UserField user_field(user_field_id_t id) const noexcept;
+  ::std::set<user_field_id_t> user_field_ids() const noexcept;
+
+  //Decodes the whole pool
+  Pool to_pool() const;
+};
+
+} // namespace csdb
+
+#endif // _CREDITS_CSDB_POOL_VIEW_H_INCLUDED_
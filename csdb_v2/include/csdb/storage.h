@@ -11,6 +11,8 @@
 #include <vector>
 #include <memory>
 #include <functional>
+#include <map>
+#include <cstdint>
 
 #include "csdb/transaction.h"
 #include "csdb/database.h"
@@ -18,11 +20,14 @@
 namespace csdb {
 
 class Pool;
+class PoolView;
 class PoolHash;
 class Address;
 class Wallet;
 class Transaction;
 class TransactionID;
+class Currency;
+class Amount;
 
 //Storage class
 class Storage final
@@ -64,9 +69,28 @@ public:
   WeakPtr weak_ptr() const noexcept;
 
 public:
+  //Default budget of the decoded pool cache
+  static const size_t DEFAULT_CACHE_SIZE = 64 * 1024 * 1024;
+
   struct OpenOptions
   {
     ::std::shared_ptr<Database> db;
+    //Rescan and verify every pool instead of starting from the saved chain tip
+    bool verify = false;
+    //Number of threads verifying pools during the rescan, 0 for the number of cores
+    size_t verify_threads = 0;
+    //Memory budget of the decoded pool cache in bytes, 0 disables the cache
+    size_t cache_size = DEFAULT_CACHE_SIZE;
+    //Decode loaded pools into arenas, see Pool::from_binary
+    bool use_arena = false;
+  };
+
+  struct CacheStats
+  {
+    uint64_t hits;
+    uint64_t misses;
+    size_t pools;
+    size_t bytes;
   };
 
   struct OpenProgress
@@ -107,6 +131,15 @@ public:
   Pool pool_load(const PoolHash &hash) const;
   Pool pool_load_meta(const PoolHash &hash, size_t& cnt) const;
 
+  //Loads a read-only view of the pool, its transactions are decoded on demand
+  PoolView pool_view(const PoolHash &hash) const;
+
+  //Loads the pool of the main chain with the given sequence
+  Pool pool_load(uint64_t sequence) const;
+
+  //The hash of the main chain pool with the given sequence, empty if there is none
+  PoolHash hash_at(uint64_t sequence) const;
+
   //Getting transaction by ID
   Transaction transaction(const TransactionID &id) const;
 
@@ -119,12 +152,25 @@ public:
   //size returns the number of pools in the repository
   size_t size() const noexcept;
 
+  //Counters of the decoded pool cache, reset when the storage is closed
+  CacheStats cache_stats() const;
+
   //Receive a wallet for the specified address
   Wallet wallet(const Address &addr) const;
 
   //Get a list of transactions for the specified address
   std::vector<Transaction> transactions(const Address &addr, size_t limit = 100, const TransactionID &offset = TransactionID()) const;
 
+  //Get a list of transactions for the specified address, skipping the given number of the newest ones.
+  //Only the returned transactions are decoded, but the skipped postings are still stepped over one
+  //by one, so the cost is O(skip + limit). Paging with the TransactionID offset is O(limit).
+  std::vector<Transaction> transactions(const Address &addr, size_t limit, size_t skip) const;
+
+
+private:
+  //Reads the account table records of the address, replaying the chain into the table if it lags behind
+  bool accounts(const Address &addr, ::std::map<Currency, Amount> &amounts, ::std::map<Currency, Amount> &balances) const;
+  friend class Wallet;
 
 private:
   ::std::shared_ptr<priv> d;
@@ -22,6 +22,7 @@ class Amount;
 class Currency;
 class PoolHash;
 class Pool;
+class PoolView;
 
 //Class of unique transaction identifier in the database
 class TransactionID
@@ -87,6 +88,8 @@ public:
   static Transaction from_binary(const ::csdb::internal::byte_array data);
 
   static Transaction from_byte_stream(const char* data, size_t m_size);
+  //Decodes a transaction split over several memory blocks without joining them
+  static Transaction from_byte_stream(const ::csdb::internal::byte_span* spans, size_t count);
   std::vector<uint8_t> to_byte_stream() const;
 
   //Adds an optional custom field to the transaction
@@ -101,9 +104,15 @@ public:
 private:
   void put(::csdb::priv::obstream&) const;
   bool get(::csdb::priv::ibstream&);
+  static bool skip(::csdb::priv::ibstream&);
+  //A copy that shares no data with this one, so a transaction of an arena pool
+  //does not keep the whole pool in memory
+  Transaction clone() const;
   friend class ::csdb::priv::obstream;
   friend class ::csdb::priv::ibstream;
   friend class Pool;
+  friend class PoolView;
+  friend class Storage;
 };
 
 } // namespace csdb
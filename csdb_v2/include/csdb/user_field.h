@@ -55,8 +55,11 @@ public:
 private:
   void put(::csdb::priv::obstream&) const;
   bool get(::csdb::priv::ibstream&);
+  static bool skip(::csdb::priv::ibstream&);
+  UserField clone() const;
   friend class ::csdb::priv::obstream;
   friend class ::csdb::priv::ibstream;
+  friend class Transaction;
 };
 
 inline bool UserField::operator !=(const UserField& other) const noexcept
@@ -24,6 +24,9 @@ public:
 
   CurrencyList currencies() const noexcept;
   Amount amount(Currency currency) const noexcept;
+
+  //Balance recorded by the last outgoing transaction plus the incoming amounts after it
+  Amount balance(Currency currency) const noexcept;
 };
 
 } // namespace csdb
@@ -1,56 +1,53 @@
 #include "csdb/address.h"
+
+#include <type_traits>
+
 #include "csdb/internal/types.h"
 #include "csdb/internal/utils.h"
-#include "csdb/internal/shared_data_ptr_implementation.h"
 #include "binary_streams.h"
 
 #include "priv_crypto.h"
 
 namespace csdb {
 
-class Address::priv : public ::csdb::internal::shared_data
-{
-  ::csdb::internal::byte_array data_;
+const size_t Address::max_size;
+static_assert(::std::is_trivially_copyable<Address>::value, "csdb::Address must stay trivially copyable.");
 
-  friend class ::csdb::Address;
-};
-SHARED_DATA_CLASS_IMPLEMENTATION(Address)
+Address::Address() noexcept :
+  size_(0),
+  data_{}
+{
+}
 
 bool Address::is_valid() const noexcept
 {
-  return d->data_.size() == ::csdb::priv::crypto::public_key_size;
+  return size_ == ::csdb::priv::crypto::public_key_size;
 }
 
 bool Address::operator ==(const Address &other) const noexcept
 {
-  return (d == other.d) || (d->data_ == other.d->data_);
+  return (size_ == other.size_) && (0 == memcmp(data_, other.data_, size_));
 }
 
 bool Address::operator <(const Address &other) const noexcept
 {
-  return (d != other.d) && (d->data_ < other.d->data_);
+  const int res = memcmp(data_, other.data_, (size_ < other.size_) ? size_ : other.size_);
+  return (res < 0) || ((0 == res) && (size_ < other.size_));
 }
 
 ::std::string Address::to_string() const noexcept
 {
-  return internal::to_hex(d->data_);
+  return internal::to_hex(public_key());
 }
 
 Address Address::from_string(const ::std::string &val)
 {
-  Address res;
-
-  const ::csdb::internal::byte_array data = ::csdb::internal::from_hex( val );
-  if (::csdb::priv::crypto::public_key_size == data.size()) {
-    res.d->data_ = data;
-  }
-
-  return res;
+  return from_public_key(::csdb::internal::from_hex(val));
 }
 
 ::csdb::internal::byte_array Address::public_key() const noexcept
 {
-  return d->data_;
+  return ::csdb::internal::byte_array(data_, data_ + size_);
 }
 
 Address Address::from_public_key(const ::csdb::internal::byte_array &key)
@@ -58,7 +55,8 @@ Address Address::from_public_key(const ::csdb::internal::byte_array &key)
 	Address res;
 
 	if (::csdb::priv::crypto::public_key_size == key.size()) {
-		res.d->data_ = key;
+		res.size_ = static_cast<uint8_t>(key.size());
+		memcpy(res.data_, key.data(), key.size());
 	}
 
 	return res;
@@ -67,18 +65,30 @@ Address Address::from_public_key(const ::csdb::internal::byte_array &key)
 Address Address::from_public_key(const char* key)
 {
 	Address res;
-	res.d->data_ = ::csdb::internal::byte_array((const uint8_t*)key, (const uint8_t*)key + ::csdb::priv::crypto::public_key_size);
+	res.size_ = static_cast<uint8_t>(::csdb::priv::crypto::public_key_size);
+	memcpy(res.data_, key, ::csdb::priv::crypto::public_key_size);
 	return res;
 }
 
 void Address::put(::csdb::priv::obstream &os) const
 {
-  os.put(d->data_);
+  os.put(static_cast<size_t>(size_));
+  os.put(data_, size_);
 }
 
 bool Address::get(::csdb::priv::ibstream &is)
 {
-  return is.get(d->data_);
+  size_t size;
+  if (!is.get(size) || (max_size < size)) {
+    return false;
+  }
+  Address res;
+  if (!is.get(res.data_, size)) {
+    return false;
+  }
+  res.size_ = static_cast<uint8_t>(size);
+  *this = res;
+  return true;
 }
 
 } // namespace csdb
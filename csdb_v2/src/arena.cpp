@@ -0,0 +1,126 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <new>
+
+#include "csdb/internal/shared_data_ptr_implementation.h"
+
+namespace csdb {
+namespace internal {
+
+namespace {
+const size_t ALIGNMENT = alignof(std::max_align_t);
+const size_t MIN_BLOCK_SIZE = 256;
+
+inline size_t align_up(size_t size)
+{
+  return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+} // namespace
+
+thread_local arena* arena::current_ = nullptr;
+
+arena::scope::scope(size_t block_size) :
+  arena_(create(block_size)),
+  previous_(current_)
+{
+  current_ = arena_;
+}
+
+arena::scope::~scope()
+{
+  current_ = previous_;
+  arena_->drop();
+}
+
+arena* arena::create(size_t block_size)
+{
+  // The arena and its first block are a single allocation
+  block_size = std::max(align_up(block_size), MIN_BLOCK_SIZE);
+  void* mem = ::operator new(align_up(sizeof(arena)) + block_size);
+  return new (mem) arena(block_size);
+}
+
+arena::arena(size_t block_size) :
+  first_(reinterpret_cast<char*>(this) + align_up(sizeof(arena))),
+  pos_(first_),
+  left_(block_size),
+  block_size_(block_size),
+  refs_(1)
+{
+}
+
+arena::~arena()
+{
+  for (const auto& block : more_) {
+    ::operator delete(block.first);
+  }
+}
+
+void* arena::take(size_t size)
+{
+  size = align_up(size);
+  if (size > left_) {
+    // Blocks grow, so a large pool takes a few of them
+    block_size_ *= 2;
+    const size_t block_size = std::max(size, block_size_);
+    more_.emplace_back(static_cast<char*>(::operator new(block_size)), block_size);
+    pos_ = more_.back().first;
+    left_ = block_size;
+  }
+  void* res = pos_;
+  pos_ += size;
+  left_ -= size;
+  ++refs_;
+  return res;
+}
+
+void arena::drop() noexcept
+{
+  if (0 == (--refs_)) {
+    this->~arena();
+    ::operator delete(this);
+  }
+}
+
+void* arena::allocate(size_t size)
+{
+  return (nullptr != current_) ? current_->take(size) : ::operator new(size);
+}
+
+void arena::release(arena* owner) noexcept
+{
+  owner->drop();
+}
+
+void* shared_data::operator new(std::size_t size)
+{
+  return arena::allocate(size);
+}
+
+void shared_data::operator delete(void* ptr) noexcept
+{
+  // Only reached right after new, when a constructor throws or a failed decode deletes
+  // the new object, so the memory is taken from the current arena if there is one.
+  // shared_data::destroy frees everything else.
+  arena* owner = arena::current();
+  if (nullptr != owner) {
+    arena::release(owner);
+  }
+  else {
+    ::operator delete(ptr);
+  }
+}
+
+arena* shared_data::arena_of() noexcept
+{
+  return arena::current();
+}
+
+void shared_data::release(arena* owner) noexcept
+{
+  arena::release(owner);
+}
+
+} // namespace internal
+} // namespace csdb
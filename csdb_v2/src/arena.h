@@ -0,0 +1,71 @@
+#pragma once
+#ifndef _CREDITS_CSDB_PRIVATE_ARENA_H_INCLUDED_
+#define _CREDITS_CSDB_PRIVATE_ARENA_H_INCLUDED_
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace csdb {
+namespace internal {
+
+// Monotonic buffer for the shared data of a decoded pool. The arena is only used while
+// its scope is active on the thread; everything else stays on the heap. Every object
+// remembers its arena in shared_data::arena_ and tells it when it is destroyed, and the
+// memory is freed in one step after the last object and the scope are gone.
+//
+// Only the shared data privs are placed in arenas. Byte arrays and the user field maps
+// keep the standard allocator, because their types are part of the public API.
+class arena
+{
+public:
+  // While the scope exists, shared data created on this thread is taken from a new arena.
+  // Scopes nest, the innermost one is used.
+  class scope
+  {
+  public:
+    explicit scope(size_t block_size);
+    ~scope();
+
+  private:
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+
+    arena* arena_;
+    arena* previous_;
+  };
+
+  // Takes the memory from the arena of the current scope, or from the heap without one
+  static void* allocate(size_t size);
+
+  // While a scope is active all shared data is taken from its arena
+  static arena* current() noexcept { return current_; }
+
+  // Called once for every object taken from the arena when it is destroyed
+  static void release(arena* owner) noexcept;
+
+private:
+  static arena* create(size_t block_size);
+  explicit arena(size_t block_size);
+  ~arena();
+  arena(const arena&) = delete;
+  arena& operator=(const arena&) = delete;
+
+  void* take(size_t size);
+  void drop() noexcept;
+
+  char* first_;                                 // Placed right after the arena itself
+  std::vector<std::pair<char*, size_t>> more_;  // Blocks taken once the first one is full
+  char* pos_;
+  size_t left_;
+  size_t block_size_;
+  std::atomic<size_t> refs_;                    // Live objects plus one for the scope
+
+  static thread_local arena* current_;
+};
+
+} // namespace internal
+} // namespace csdb
+
+#endif // _CREDITS_CSDB_PRIVATE_ARENA_H_INCLUDED_
@@ -1,5 +1,6 @@
 #include "binary_streams.h"
 #include "integral_encdec.h"
+#include <algorithm>
 #include <cstring>
 
 namespace csdb {
@@ -23,16 +24,66 @@ void obstream::put(const internal::byte_array &value)
   buffer_.insert(buffer_.end(), value.begin(), value.end());
 }
 
+ibstream::ibstream(const internal::byte_span* spans, size_t count) :
+  data_(nullptr),
+  size_(0),
+  next_(spans),
+  last_(spans + count)
+{
+  for (const internal::byte_span* span = next_; span != last_; ++span) {
+    rest_ += span->size;
+  }
+  advance_spans(0);
+}
+
+// Skips size bytes, at least the rest of the current span, and stops on a non-empty span
+void ibstream::advance_spans(size_t size)
+{
+  for (;;) {
+    const size_t step = std::min(size, size_);
+    data_ = static_cast<const uint8_t*>(data_) + step;
+    size_ -= step;
+    size -= step;
+
+    if ((0 != size_) || (next_ == last_)) {
+      break;
+    }
+
+    data_ = next_->data;
+    size_ = next_->size;
+    rest_ -= size_;
+    ++next_;
+  }
+}
+
+size_t ibstream::peek(void *buf, size_t size) const
+{
+  uint8_t *dst = static_cast<uint8_t*>(buf);
+  size_t res = std::min(size, size_);
+  std::memcpy(dst, data_, res);
+
+  for (const internal::byte_span* span = next_; (span != last_) && (res < size); ++span) {
+    const size_t step = std::min(size - res, span->size);
+    std::memcpy(dst + res, span->data, step);
+    res += step;
+  }
+
+  return res;
+}
+
 bool ibstream::get(void *buf, size_t size)
 {
-  if (size > size_) {
+  if (size > this->size()) {
     return false;
   }
 
-  const uint8_t *src = static_cast<const uint8_t*>(data_);
-  std::memmove(buf, src, size);
-  size_ -= size;
-  data_ = static_cast<const void*>(src + size);
+  if (size <= size_) {
+    std::memmove(buf, data_, size);
+  }
+  else {
+    peek(buf, size);
+  }
+  advance(size);
   return true;
 }
 
@@ -42,14 +93,18 @@ bool ibstream::get(std::string &value)
   if (!get(size)) {
     return false;
   }
-  if (size > size_) {
+  if (size > this->size()) {
     return false;
   }
 
-  const char *data = static_cast<const char*>(data_);
-  value.assign(data, size);
-  size_ -= size;
-  data_ = static_cast<const void*>(data + size);
+  if (size <= size_) {
+    value.assign(static_cast<const char*>(data_), size);
+  }
+  else {
+    value.resize(size);
+    peek(&value[0], size);
+  }
+  advance(size);
   return true;
 }
 
@@ -59,14 +114,33 @@ bool ibstream::get(internal::byte_array &value)
   if (!get(size)) {
     return false;
   }
-  if (size > size_) {
+  if (size > this->size()) {
+    return false;
+  }
+
+  if (size <= size_) {
+    const uint8_t *data = static_cast<const uint8_t*>(data_);
+    value.assign(data, data + size);
+  }
+  else {
+    value.resize(size);
+    peek(value.data(), size);
+  }
+  advance(size);
+  return true;
+}
+
+bool ibstream::skip_bytes()
+{
+  size_t size;
+  if (!get(size)) {
+    return false;
+  }
+  if (size > this->size()) {
     return false;
   }
 
-  const uint8_t *data = static_cast<const uint8_t*>(data_);
-  value.assign(data, data + size);
-  size_ -= size;
-  data_ = static_cast<const void*>(data + size);
+  advance(size);
   return true;
 }
 
@@ -45,11 +45,17 @@ public:
   template<typename T>
   explicit inline ibstream(const T& d) : data_(d.data()), size_(d.size()) {}
 
+  // Reads the spans one after another as a single buffer, without joining them
+  ibstream(const internal::byte_span* spans, size_t count);
+
 public:
   bool get(void *buf, size_t size);
   bool get(std::string &value);
   bool get(internal::byte_array &value);
 
+  // Skips a string or a byte array without copying it
+  bool skip_bytes();
+
   template<typename T>
   typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, bool>::type
   get(T& value);
@@ -63,17 +69,33 @@ public:
 
   inline size_t size() const noexcept
   {
-    return size_;
+    return size_ + rest_;
   }
 
   inline bool empty() const noexcept
   {
-    return (0 == size_);
+    return (0 == size());
   }
 
+  // The unread part of the current span
+  inline const void* data() const noexcept
+  {
+    return data_;
+  }
+
+private:
+  inline void advance(size_t size);
+  void advance_spans(size_t size);
+  size_t peek(void *buf, size_t size) const;
+
 private:
   const void* data_;
   size_t size_;
+
+  // The spans after the current one and their total size
+  const internal::byte_span* next_ = nullptr;
+  const internal::byte_span* last_ = nullptr;
+  size_t rest_ = 0;
 };
 
 } // namespace priv
@@ -107,14 +129,29 @@ void obstream::put(const ::std::map<K, T, C, A>& value)
   }
 }
 
+inline void ibstream::advance(size_t size)
+{
+  if (size < size_) {
+    data_ = static_cast<const uint8_t*>(data_) + size;
+    size_ -= size;
+  }
+  else {
+    advance_spans(size);
+  }
+}
+
 template<typename T>
 typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, bool>::type
 inline ibstream::get(T& value)
 {
   std::size_t res = ::csdb::priv::decode(data_, size_, value);
+  if ((0 == res) && (0 != rest_)) {
+    // The value crosses the border of the spans
+    uint8_t buf[::csdb::priv::MAX_INTEGRAL_ENCODED_SIZE];
+    res = ::csdb::priv::decode(buf, peek(buf, sizeof(buf)), value);
+  }
   if (0 != res) {
-    data_ = static_cast<const uint8_t*>(data_) + res;
-    size_ -= res;
+    advance(res);
   }
   return (0 != res);
 }
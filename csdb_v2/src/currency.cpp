@@ -1,35 +1,26 @@
 #include "csdb/currency.h"
-#include "csdb/internal/shared_data_ptr_implementation.h"
 #include "binary_streams.h"
 
 namespace csdb {
 
-class Currency::priv : public ::csdb::internal::shared_data
-{
-public:
-  std::string name;
-};
-SHARED_DATA_CLASS_IMPLEMENTATION(Currency)
-
 Currency::Currency(const std::string &name) :
-  Currency()
+  name_(name)
 {
-  d->name = name;
 }
 
 bool Currency::is_valid() const noexcept
 {
-  return !d->name.empty();
+  return !name_.empty();
 }
 
 std::string Currency::to_string() const noexcept
 {
-  return d->name;
+  return name_;
 }
 
 bool Currency::operator ==(const Currency &other) const noexcept
 {
-  return d->name == other.d->name;
+  return name_ == other.name_;
 }
 
 bool Currency::operator !=(const Currency &other) const noexcept
@@ -39,17 +30,17 @@ bool Currency::operator !=(const Currency &other) const noexcept
 
 bool Currency::operator <(const Currency &other) const noexcept
 {
-  return d->name < other.d->name;
+  return name_ < other.name_;
 }
 
 void Currency::put(::csdb::priv::obstream &os) const
 {
-  os.put(d->name);
+  os.put(name_);
 }
 
 bool Currency::get(::csdb::priv::ibstream &is)
 {
-  return is.get(d->name);
+  return is.get(name_);
 }
 
 } // namespace csdb
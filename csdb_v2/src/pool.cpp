@@ -1,5 +1,7 @@
 #include "csdb/pool.h"
 
+#include <cstring>
+#include <type_traits>
 #include <sstream>
 #include <iomanip>
 #include <map>
@@ -11,35 +13,38 @@
 #include "csdb/internal/utils.h"
 #include "binary_streams.h"
 #include "priv_crypto.h"
+#include "arena.h"
 #include "transaction_p.h"
 
 namespace csdb {
 
-class PoolHash::priv : public ::csdb::internal::shared_data
+const size_t PoolHash::max_size;
+static_assert(::std::is_trivially_copyable<PoolHash>::value, "csdb::PoolHash must stay trivially copyable.");
+
+PoolHash::PoolHash() noexcept :
+  size_(0),
+  value_{}
 {
-public:
-  internal::byte_array value;
-};
-SHARED_DATA_CLASS_IMPLEMENTATION(PoolHash)
+}
 
 bool PoolHash::is_empty() const noexcept
 {
-  return d->value.empty();
+  return (0 == size_);
 }
 
 size_t PoolHash::size()  const noexcept
 {
-  return d->value.size();
+  return size_;
 }
 
 std::string PoolHash::to_string() const noexcept
 {
-  return internal::to_hex(d->value);
+  return internal::to_hex(to_binary());
 }
 
 ::csdb::internal::byte_array PoolHash::to_binary() const noexcept
 {
-  return d->value;
+  return ::csdb::internal::byte_array(value_, value_ + size_);
 }
 
 PoolHash PoolHash::from_binary(const ::csdb::internal::byte_array& data)
@@ -49,51 +54,60 @@ PoolHash PoolHash::from_binary(const ::csdb::internal::byte_array& data)
   if ((0 == sz)
       || (::csdb::priv::crypto::hash_size == sz)
       ) {
-    res.d->value = data;
+    res.size_ = static_cast<uint8_t>(sz);
+    memcpy(res.value_, data.data(), sz);
   }
   return res;
 }
 
 bool PoolHash::operator ==(const PoolHash &other) const noexcept
 {
-  return (d == other.d) || (d->value == other.d->value);
+  return (size_ == other.size_) && (0 == memcmp(value_, other.value_, size_));
 }
 
 bool PoolHash::operator <(const PoolHash &other) const noexcept
 {
-  return (d != other.d) && (d->value < other.d->value);
+  const int res = memcmp(value_, other.value_, (size_ < other.size_) ? size_ : other.size_);
+  return (res < 0) || ((0 == res) && (size_ < other.size_));
 }
 
 PoolHash PoolHash::from_string(const ::std::string& str)
 {
-  const ::csdb::internal::byte_array hash = ::csdb::internal::from_hex(str);
-  const size_t sz = hash.size();
-  PoolHash res;
-  if ((0 == sz)
-      || (::csdb::priv::crypto::hash_size == sz)
-      ) {
-    res.d->value = hash;
-  }
-  return res;
+  return from_binary(::csdb::internal::from_hex(str));
 }
 
 PoolHash PoolHash::calc_from_data(const internal::byte_array &data)
 {
-  PoolHash res;
-  res.d->value = ::csdb::priv::crypto::calc_hash(data);
-  return res;
+  return from_binary(::csdb::priv::crypto::calc_hash(data));
 }
 
 void PoolHash::put(::csdb::priv::obstream &os) const
 {
-  os.put(d->value);
+  os.put(static_cast<size_t>(size_));
+  os.put(value_, size_);
 }
 
 bool PoolHash::get(::csdb::priv::ibstream &is)
 {
-  return is.get(d->value);
+  size_t size;
+  if (!is.get(size) || (max_size < size)) {
+    return false;
+  }
+  PoolHash res;
+  if (!is.get(res.value_, size)) {
+    return false;
+  }
+  res.size_ = static_cast<uint8_t>(size);
+  *this = res;
+  return true;
 }
 
+namespace {
+// The decoded privs of a transaction take about four times its encoding, so the first
+// arena block usually holds the whole pool
+const size_t ARENA_SIZE_FACTOR = 5;
+} // namespace
+
 class Pool::priv : public ::csdb::internal::shared_data
 {
   priv() : is_valid_(false), read_only_(false), sequence_(0) {}
@@ -133,6 +147,20 @@ class Pool::priv : public ::csdb::internal::shared_data
 	  return true;
   }
 
+  void put_header(::csdb::priv::obstream& os) const
+  {
+    os.put(previous_hash_);
+    os.put(sequence_);
+    os.put(transactions_.size());
+    os.put(binary_representation_.size());
+    os.put(user_fields_);
+  }
+
+  bool get_header(::csdb::priv::ibstream& is, size_t& cnt, size_t& size)
+  {
+    return is.get(previous_hash_) && is.get(sequence_) && is.get(cnt) && is.get(size) && is.get(user_fields_);
+  }
+
   bool get(::csdb::priv::ibstream& is)
   {
 	size_t cnt;
@@ -359,6 +387,13 @@ void Pool::set_previous_hash(PoolHash previous_hash) noexcept
 
 void Pool::set_storage(Storage storage) noexcept
 {
+  // A pool shared with the storage cache is not copied just to set the same storage again
+  const priv* current = d.constData();
+  const Storage::WeakPtr ptr = storage.weak_ptr();
+  if (current->is_valid_ && !current->storage_.owner_before(ptr) && !ptr.owner_before(current->storage_)) {
+    return;
+  }
+
   // We can set up storage even if Pool is read-only
   priv* data = d.data();
   data->is_valid_ = true;
@@ -432,6 +467,16 @@ Pool Pool::from_binary(const ::csdb::internal::byte_array& data)
 	return Pool(p);
 }
 
+Pool Pool::from_binary(const ::csdb::internal::byte_array& data, bool use_arena)
+{
+  if (!use_arena) {
+    return from_binary(data);
+  }
+
+  ::csdb::internal::arena::scope scope(data.size() * ARENA_SIZE_FACTOR);
+  return from_binary(data);
+}
+
 Pool Pool::meta_from_binary(const ::csdb::internal::byte_array& data, size_t& cnt)
 {
 	priv *p = new priv();
@@ -442,10 +487,34 @@ Pool Pool::meta_from_binary(const ::csdb::internal::byte_array& data, size_t& cn
 		return Pool();
 	}
 
+	p->is_valid_ = true;
 	p->binary_representation_ = data;
 	return Pool(p);
 }
 
+::csdb::internal::byte_array Pool::header_to_binary() const
+{
+  ::csdb::priv::obstream os;
+  d->put_header(os);
+  return os.buffer();
+}
+
+Pool Pool::header_from_binary(const PoolHash& hash, const ::csdb::internal::byte_array& data, size_t& cnt)
+{
+  priv *p = new priv();
+  ::csdb::priv::ibstream is(data.data(), data.size());
+
+  size_t size;
+  if (!p->get_header(is, cnt, size)) {
+    delete p;
+    return Pool();
+  }
+
+  p->is_valid_ = true;
+  p->hash_ = hash;
+  return Pool(p);
+}
+
   Pool Pool::from_byte_stream(const char* data, size_t size) {
     priv *p = new priv();
     ::csdb::priv::ibstream is(data, size);
@@ -458,6 +527,18 @@ Pool Pool::meta_from_binary(const ::csdb::internal::byte_array& data, size_t& cn
     return Pool(p);
   }
 
+  Pool Pool::from_byte_stream(const ::csdb::internal::byte_span* spans, size_t count) {
+    priv *p = new priv();
+    ::csdb::priv::ibstream is(spans, count);
+
+    if (!p->get(is)) {
+      delete p;
+      return Pool();
+    }
+
+    return Pool(p);
+  }
+
   char* Pool::to_byte_stream(size_t& size) {
 	  if (d->binary_representation_.empty()) {
 		  ::csdb::priv::obstream os;
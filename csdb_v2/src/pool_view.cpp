@@ -0,0 +1,138 @@
+#include "csdb/pool_view.h"
+
+#include <map>
+#include <vector>
+
+#include "csdb/internal/shared_data_ptr_implementation.h"
+#include "binary_streams.h"
+#include "transaction_p.h"
+
+namespace csdb {
+
+class PoolView::priv : public ::csdb::internal::shared_data
+{
+  priv() : is_valid_(false), sequence_(0) {}
+
+  bool get(::csdb::priv::ibstream& is)
+  {
+    size_t cnt;
+    if (!is.get(previous_hash_) || !is.get(sequence_) || !is.get(cnt)) {
+      return false;
+    }
+
+    // Every transaction takes more than a byte, so a bigger count is broken data
+    if (cnt > is.size()) {
+      return false;
+    }
+
+    const uint8_t* begin = data_.data();
+    offsets_.reserve(cnt + 1);
+    for (size_t i = 0; i < cnt; ++i) {
+      offsets_.push_back(static_cast<const uint8_t*>(is.data()) - begin);
+      if (!Transaction::skip(is)) {
+        return false;
+      }
+    }
+    offsets_.push_back(static_cast<const uint8_t*>(is.data()) - begin);
+
+    return is.get(user_fields_);
+  }
+
+  bool is_valid_;
+  PoolHash hash_;
+  PoolHash previous_hash_;
+  Pool::sequence_t sequence_;
+  ::csdb::internal::byte_array data_;
+  std::vector<size_t> offsets_;       // Offsets of the transactions, followed by the end of the last one
+  ::std::map<::csdb::user_field_id_t, ::csdb::UserField> user_fields_;
+  friend class PoolView;
+};
+SHARED_DATA_CLASS_IMPLEMENTATION(PoolView)
+
+PoolView PoolView::from_binary(const PoolHash& hash, ::csdb::internal::byte_array data)
+{
+  priv *p = new priv();
+  p->data_ = ::std::move(data);
+  ::csdb::priv::ibstream is(p->data_.data(), p->data_.size());
+  if (!p->get(is)) {
+    delete p;
+    return PoolView();
+  }
+
+  p->hash_ = hash;
+  p->is_valid_ = true;
+  return PoolView(p);
+}
+
+bool PoolView::is_valid() const noexcept
+{
+  return d->is_valid_;
+}
+
+PoolHash PoolView::hash() const noexcept
+{
+  return d->hash_;
+}
+
+PoolHash PoolView::previous_hash() const noexcept
+{
+  return d->previous_hash_;
+}
+
+Pool::sequence_t PoolView::sequence() const noexcept
+{
+  return d->sequence_;
+}
+
+size_t PoolView::transactions_count() const noexcept
+{
+  return d->offsets_.empty() ? 0 : (d->offsets_.size() - 1);
+}
+
+Transaction PoolView::transaction(size_t index) const
+{
+  const priv* data = d.constData();
+  if (transactions_count() <= index) {
+    return Transaction{};
+  }
+
+  const size_t offset = data->offsets_[index];
+  ::csdb::priv::ibstream is(data->data_.data() + offset, data->offsets_[index + 1] - offset);
+  Transaction res;
+  if (!res.get(is)) {
+    return Transaction{};
+  }
+  res.d->_update_id(data->hash_, index);
+  return res;
+}
+
+Transaction PoolView::transaction(TransactionID id) const
+{
+  if ((!id.is_valid()) || (id.pool_hash() != d->hash_)) {
+    return Transaction{};
+  }
+  return transaction(id.index());
+}
+
+UserField PoolView::user_field(user_field_id_t id) const noexcept
+{
+  const priv* data = d.constData();
+  auto it = data->user_fields_.find(id);
+  return (data->user_fields_.end() == it) ? UserField{} : it->second;
+}
+
+::std::set<user_field_id_t> PoolView::user_field_ids() const noexcept
+{
+  ::std::set<user_field_id_t> res;
+  for (const auto& it : d->user_fields_) {
+    res.insert(it.first);
+  }
+  return res;
+}
+
+Pool PoolView::to_pool() const
+{
+  return d->is_valid_ ? Pool::from_binary(d->data_) : Pool{};
+}
+
+} // namespace csdb
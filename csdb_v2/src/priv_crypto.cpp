@@ -1,5 +1,8 @@
 #include "priv_crypto.h"
 
+#include "csdb/address.h"
+#include "csdb/pool.h"
+
 #ifndef CSDB_UNIT_TEST
 #include "cscrypto/cscrypto.h"
 #else
@@ -9,14 +12,23 @@
 namespace csdb {
 namespace priv {
 
+namespace {
 #ifndef CSDB_UNIT_TEST
-const size_t crypto::hash_size = cscrypto::Hash::sizeBytes;
-const size_t crypto::public_key_size = cscrypto::PublicKey::sizeBytes;
+constexpr size_t HASH_SIZE = cscrypto::Hash::sizeBytes;
+constexpr size_t PUBLIC_KEY_SIZE = cscrypto::PublicKey::sizeBytes;
 #else
-const size_t crypto::hash_size = sizeof(size_t);
-const size_t crypto::public_key_size = 20;
+constexpr size_t HASH_SIZE = sizeof(size_t);
+constexpr size_t PUBLIC_KEY_SIZE = 20;
 #endif
 
+// Address and PoolHash keep their values inline
+static_assert(HASH_SIZE <= PoolHash::max_size, "PoolHash::max_size is too small for the hash");
+static_assert(PUBLIC_KEY_SIZE <= Address::max_size, "Address::max_size is too small for the public key");
+} // namespace
+
+const size_t crypto::hash_size = HASH_SIZE;
+const size_t crypto::public_key_size = PUBLIC_KEY_SIZE;
+
 internal::byte_array crypto::calc_hash(const internal::byte_array &buffer) noexcept
 {
 #ifndef CSDB_UNIT_TEST
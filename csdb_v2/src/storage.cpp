@@ -6,17 +6,29 @@
 #include <set>
 #include <list>
 #include <map>
+#include <unordered_map>
 #include <deque>
 #include <cassert>
+#include <cinttypes>
+#include <cstring>
 #include <stdexcept>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "csdb/address.h"
+#include "csdb/amount.h"
+#include "csdb/currency.h"
 #include "csdb/wallet.h"
 #include "csdb/pool.h"
+#include "csdb/pool_view.h"
 #include "csdb/database.h"
 #include "csdb/database_leveldb.h"
 #include "csdb/internal/utils.h"
+#include "csdb/internal/endian.h"
 #include "binary_streams.h"
+#include "priv_crypto.h"
 
 namespace csdb {
 
@@ -30,8 +42,8 @@ struct head_info_t
   PoolHash next_;     //Hash of the next pool, or an empty string for the first pool
                       
 };
-using heads_t = std::map<PoolHash, head_info_t>;
-using tails_t = std::map<PoolHash, PoolHash>;
+using heads_t = std::unordered_map<PoolHash, head_info_t>;
+using tails_t = std::unordered_map<PoolHash, PoolHash>;
 
 void update_heads_and_tails(heads_t &heads, tails_t &tails, const PoolHash &cur_hash, const PoolHash &prev_hash)
 {
@@ -77,16 +89,421 @@ void update_heads_and_tails(heads_t &heads, tails_t &tails, const PoolHash &cur_
   }
 }
 
+// Service records are kept in the same database as pools. Pool keys are bare
+// hashes, service keys start with a zero byte and a record type tag and never
+// have the length of a hash.
+enum ServiceRecord : uint8_t {
+  AccountRecord = 'A',
+  TransactionIndexRecord = 'T',
+  HeightRecord = 'H',
+  PoolHeaderRecord = 'P',
+  ChainStateRecord = 'C',
+  IndexStateRecord = 'S',
+};
+
+::csdb::internal::byte_array service_key(ServiceRecord type)
+{
+  return ::csdb::internal::byte_array{0, static_cast<uint8_t>(type)};
+}
+
+bool is_service_key(const ::csdb::internal::byte_array& key)
+{
+  return (2 <= key.size()) && (::csdb::priv::crypto::hash_size != key.size()) && (0 == key[0]);
+}
+
+bool has_prefix(const ::csdb::internal::byte_array& key, const ::csdb::internal::byte_array& prefix)
+{
+  return (key.size() >= prefix.size()) && std::equal(prefix.begin(), prefix.end(), key.begin());
+}
+
+// Looks a service record up without touching the last error of the database
+bool read_service_record(Database& db, const ::csdb::internal::byte_array& key, ::csdb::internal::byte_array& value)
+{
+  Database::IteratorPtr it = db.new_iterator();
+  it->seek(key);
+  if (!it->is_valid() || (it->key() != key)) {
+    return false;
+  }
+  value = it->value();
+  return true;
+}
+
+template<typename T>
+void put_big_endian(::csdb::internal::byte_array& key, T value)
+{
+  value = ::csdb::internal::to_big_endian(value);
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(&value);
+  key.insert(key.end(), data, data + sizeof(T));
+}
+
+template<typename T>
+T get_big_endian(const uint8_t* data)
+{
+  T value;
+  std::memcpy(&value, data, sizeof(T));
+  return ::csdb::internal::from_big_endian(value);
+}
+
+// Key of the account record: service prefix, address, currency name.
+::csdb::internal::byte_array account_key(const Address& addr)
+{
+  ::csdb::internal::byte_array key = service_key(AccountRecord);
+  const ::csdb::internal::byte_array pk = addr.public_key();
+  key.insert(key.end(), pk.begin(), pk.end());
+  return key;
+}
+
+::csdb::internal::byte_array account_key(const Address& addr, const Currency& currency)
+{
+  ::csdb::internal::byte_array key = account_key(addr);
+  const ::std::string name = currency.to_string();
+  key.insert(key.end(), name.begin(), name.end());
+  return key;
+}
+
+struct account_t
+{
+  Amount amount_;     // Sum of all incoming minus all outgoing amounts
+  Amount balance_;    // Balance recorded by the last outgoing transaction plus incoming amounts after it
+
+  void put(::csdb::priv::obstream& os) const
+  {
+    os.put(amount_);
+    os.put(balance_);
+  }
+
+  bool get(::csdb::priv::ibstream& is)
+  {
+    return is.get(amount_) && is.get(balance_);
+  }
+};
+using accounts_t = std::map<::csdb::internal::byte_array, account_t>;
+
+// Key of the pool header record: service prefix, pool hash.
+::csdb::internal::byte_array header_key(const PoolHash& hash)
+{
+  ::csdb::internal::byte_array key = service_key(PoolHeaderRecord);
+  const ::csdb::internal::byte_array h = hash.to_binary();
+  key.insert(key.end(), h.begin(), h.end());
+  return key;
+}
+
+// Key of the main chain record: service prefix, pool sequence. The value is the pool hash.
+::csdb::internal::byte_array height_key(Pool::sequence_t sequence)
+{
+  ::csdb::internal::byte_array key = service_key(HeightRecord);
+  put_big_endian(key, static_cast<uint64_t>(sequence));
+  return key;
+}
+
+// Key of the transaction index record: service prefix, address, pool sequence,
+// transaction index. Keys of one address are sorted by their position in the chain.
+::csdb::internal::byte_array posting_key(const Address& addr)
+{
+  ::csdb::internal::byte_array key = service_key(TransactionIndexRecord);
+  const ::csdb::internal::byte_array pk = addr.public_key();
+  key.insert(key.end(), pk.begin(), pk.end());
+  return key;
+}
+
+::csdb::internal::byte_array posting_key(const Address& addr, Pool::sequence_t sequence, uint32_t index)
+{
+  ::csdb::internal::byte_array key = posting_key(addr);
+  put_big_endian(key, static_cast<uint64_t>(sequence));
+  put_big_endian(key, index);
+  return key;
+}
+
+enum PostingFlags : uint8_t {
+  PostingSource = 1,
+  PostingTarget = 2,
+};
+
+struct posting_t
+{
+  PoolHash pool_hash_;
+  uint8_t flags_ = 0;
+
+  void put(::csdb::priv::obstream& os) const
+  {
+    os.put(pool_hash_);
+    os.put(flags_);
+  }
+
+  bool get(::csdb::priv::ibstream& is)
+  {
+    return is.get(pool_hash_) && is.get(flags_);
+  }
+};
+
+// Checkpoint of the chain tip. It is kept only while every pool of the storage
+// belongs to the main chain, so opening the storage may skip the rescan.
+struct chain_state_t
+{
+  PoolHash last_hash_;
+  size_t count_pool_ = 0;
+
+  void put(::csdb::priv::obstream& os) const
+  {
+    os.put(last_hash_);
+    os.put(count_pool_);
+  }
+
+  bool get(::csdb::priv::ibstream& is)
+  {
+    return is.get(last_hash_) && is.get(count_pool_);
+  }
+};
+
+// A pool read during the rescan. The key is checked against the real hash of the
+// pool and the pool is decoded by a worker thread.
+struct scanned_pool_t
+{
+  ::csdb::internal::byte_array key_;
+  ::csdb::internal::byte_array value_;
+  PoolHash hash_;
+  PoolHash real_hash_;
+  Pool pool_;
+};
+
+const size_t RESCAN_POOLS_PER_THREAD = 16;
+
+void scan_pool(scanned_pool_t& item)
+{
+  item.hash_ = PoolHash::from_binary(item.key_);
+  if (item.hash_.is_empty()) {
+    return;
+  }
+
+  // Decoding hashes the pool anyway, so the hash is calculated once more only for broken pools
+  item.pool_ = Pool::from_binary(item.value_);
+  item.real_hash_ = item.pool_.is_valid() ? item.pool_.hash() : PoolHash::calc_from_data(item.value_);
+  item.value_.clear();
+}
+
+// Bounded ring between the rescan stages. The reader fills the slots in the key order,
+// the workers decode them in any order and the merger takes them back in the key order,
+// so the three stages overlap while at most `capacity` pools are held in memory.
+class scan_queue
+{
+public:
+  explicit scan_queue(size_t capacity) :
+    slots_(capacity)
+  {
+  }
+
+  // Blocks while the ring is full. False once the scan is cancelled
+  bool push(scanned_pool_t&& item)
+  {
+    ::std::unique_lock<::std::mutex> lock(mutex_);
+    space_.wait(lock, [this] { return cancelled_ || (read_ - merged_ < slots_.size()); });
+    if (cancelled_) {
+      return false;
+    }
+    slot_t& slot = slots_[read_ % slots_.size()];
+    slot.item_ = ::std::move(item);
+    slot.scanned_ = false;
+    ++read_;
+    work_.notify_one();
+    return true;
+  }
+
+  // No more pools to read
+  void finish()
+  {
+    ::std::lock_guard<::std::mutex> lock(mutex_);
+    finished_ = true;
+    work_.notify_all();
+    done_.notify_all();
+  }
+
+  void cancel()
+  {
+    ::std::lock_guard<::std::mutex> lock(mutex_);
+    cancelled_ = true;
+    space_.notify_all();
+    work_.notify_all();
+    done_.notify_all();
+  }
+
+  // Decodes pools until the reader is done and the ring is drained
+  void work()
+  {
+    ::std::unique_lock<::std::mutex> lock(mutex_);
+    for (;;) {
+      work_.wait(lock, [this] { return cancelled_ || finished_ || (scanning_ < read_); });
+      if (cancelled_ || (scanning_ == read_)) {
+        return;
+      }
+      slot_t& slot = slots_[scanning_ % slots_.size()];
+      ++scanning_;
+
+      // The slot is not reused before the merger takes it, which waits for scanned_
+      lock.unlock();
+      scan_pool(slot.item_);
+      lock.lock();
+
+      slot.scanned_ = true;
+      done_.notify_one();
+    }
+  }
+
+  // The next pool in the key order. False when all of them are merged or the scan is cancelled
+  bool pop(scanned_pool_t& item)
+  {
+    ::std::unique_lock<::std::mutex> lock(mutex_);
+    done_.wait(lock, [this] {
+      return cancelled_ || ((merged_ < scanning_) && slots_[merged_ % slots_.size()].scanned_)
+             || (finished_ && (merged_ == read_));
+    });
+    if (cancelled_ || (merged_ == read_)) {
+      return false;
+    }
+    slot_t& slot = slots_[merged_ % slots_.size()];
+    item = ::std::move(slot.item_);
+    slot.item_ = scanned_pool_t{};
+    ++merged_;
+    space_.notify_one();
+    return true;
+  }
+
+private:
+  struct slot_t
+  {
+    scanned_pool_t item_;
+    bool scanned_ = false;
+  };
+
+  ::std::vector<slot_t> slots_;
+  ::std::mutex mutex_;
+  ::std::condition_variable space_;
+  ::std::condition_variable work_;
+  ::std::condition_variable done_;
+  uint64_t read_ = 0;
+  uint64_t scanning_ = 0;
+  uint64_t merged_ = 0;
+  bool finished_ = false;
+  bool cancelled_ = false;
+};
+
+// Decoded pools kept within a memory budget, the least recently used go first.
+// A pool is charged by the size of its binary representation.
+class pool_cache_t
+{
+public:
+  void set_budget(size_t bytes)
+  {
+    std::lock_guard<std::mutex> l(lock_);
+    budget_ = bytes;
+    shrink();
+  }
+
+  bool get(const PoolHash& hash, Pool& pool)
+  {
+    std::lock_guard<std::mutex> l(lock_);
+    auto it = index_.find(hash);
+    if (index_.end() == it) {
+      ++misses_;
+      return false;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second);
+    pool = it->second->pool_;
+    ++hits_;
+    return true;
+  }
+
+  void put(const PoolHash& hash, const Pool& pool, size_t size)
+  {
+    std::lock_guard<std::mutex> l(lock_);
+    if ((size > budget_) || (0 != index_.count(hash))) {
+      return;
+    }
+    entries_.push_front(entry_t{hash, pool, size});
+    index_.emplace(hash, entries_.begin());
+    used_ += size;
+    shrink();
+  }
+
+  void clear()
+  {
+    std::lock_guard<std::mutex> l(lock_);
+    entries_.clear();
+    index_.clear();
+    used_ = 0;
+    hits_ = 0;
+    misses_ = 0;
+  }
+
+  Storage::CacheStats stats() const
+  {
+    std::lock_guard<std::mutex> l(lock_);
+    return Storage::CacheStats{hits_, misses_, entries_.size(), used_};
+  }
+
+private:
+  void shrink()
+  {
+    while (used_ > budget_) {
+      used_ -= entries_.back().size_;
+      index_.erase(entries_.back().hash_);
+      entries_.pop_back();
+    }
+  }
+
+  struct entry_t
+  {
+    PoolHash hash_;
+    Pool pool_;
+    size_t size_;
+  };
+  using entries_t = std::list<entry_t>;
+
+  mutable std::mutex lock_;
+  entries_t entries_;
+  std::unordered_map<PoolHash, entries_t::iterator> index_;
+  size_t budget_ = 0;
+  size_t used_ = 0;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+};
+
 }
 
 class Storage::priv
 {
 private:
-  bool rescan(Storage::OpenCallback callback);
+  bool rescan(Storage::OpenCallback callback, size_t threads);
+  bool restore_checkpoint();
+  ::csdb::internal::byte_array checkpoint(const PoolHash& hash, size_t count, size_t length) const;
+
+  bool read_account(const ::csdb::internal::byte_array& key, accounts_t& accounts);
+  bool apply_accounts(const Pool& pool, accounts_t& accounts);
+  void put_accounts(const accounts_t& accounts, Database::ItemList& items) const;
+  void put_postings(const Pool& pool, Database::ItemList& items) const;
+  bool drop_records(ServiceRecord type);
+  bool sync_indexes();
+  bool indexes_synced();
+
+  // Calls func(pool_hash, index, flags) for postings of the address, newest first,
+  // starting right below the key `from` (or from the newest one if `from` is empty).
+  // The first `skip` postings are stepped over by key, without reading their values.
+  // Stops as soon as func returns false.
+  template<typename F>
+  bool for_each_posting(const Address& addr, const ::csdb::internal::byte_array& from, size_t skip, F func);
+  bool collect_transactions(const Address& addr, const ::csdb::internal::byte_array& from, size_t skip, size_t limit,
+                            std::vector<Transaction>& res);
+  Transaction last_posting(const Address& addr, uint8_t flag);
+  Pool load(const PoolHash& hash, const Storage& owner);
+  PoolView load_view(const PoolHash& hash);
+  Pool load_meta(const PoolHash& hash, size_t& cnt);
 
   std::shared_ptr<Database> db = nullptr;
   PoolHash last_hash;           // Hash of the last pool
   size_t count_pool = 0;        // Number of transaction pools in the storage
+  size_t chain_length = 0;      // Number of pools in the chain ending with last_hash
+  PoolHash indexed_hash;        // Hash of the last pool applied to the account table and the indexes
+  pool_cache_t cache;           // Recently used pools
+  bool use_arena = false;       // Loaded pools are decoded into arenas
 
   Storage::Error last_error_ = Storage::NoError;
   ::std::string last_error_message_;
@@ -121,10 +538,11 @@ void Storage::priv::set_last_error(Storage::Error error, const char* message, ..
   }
 }
 
-bool Storage::priv::rescan(Storage::OpenCallback callback)
+bool Storage::priv::rescan(Storage::OpenCallback callback, size_t threads)
 {
   last_hash = {};
   count_pool = 0;
+  chain_length = 0;
 
   heads_t heads;
   tails_t tails;
@@ -132,30 +550,54 @@ bool Storage::priv::rescan(Storage::OpenCallback callback)
   Database::IteratorPtr it = db->new_iterator();
   assert(it);
 
-  Storage::OpenProgress progress{0};
-  for(it->seek_to_first(); it->is_valid(); it->next())
-  {
-    const ::csdb::internal::byte_array k = it->key();
-    const ::csdb::internal::byte_array v = it->value();
+  // Headers are written for the pools that were saved without them
+  Database::ItemList missing_headers;
+
+  // One thread reads the pools, the workers check them and this thread merges them in the key order
+  if (0 == threads) {
+    threads = ::std::max(1u, ::std::thread::hardware_concurrency());
+  }
+  scan_queue queue(threads * RESCAN_POOLS_PER_THREAD);
+
+  ::std::vector<::std::thread> stages;
+  stages.emplace_back([&queue, &it]() {
+    for (it->seek_to_first(); it->is_valid(); it->next()) {
+      ::csdb::internal::byte_array k = it->key();
+      if (is_service_key(k)) {
+        continue;
+      }
+      scanned_pool_t item;
+      item.key_ = ::std::move(k);
+      item.value_ = it->value();
+      if (!queue.push(::std::move(item))) {
+        return;
+      }
+    }
+    queue.finish();
+  });
+  for (size_t i = 0; i < threads; ++i) {
+    stages.emplace_back([&queue]() { queue.work(); });
+  }
 
-    PoolHash hash = PoolHash::from_binary(k);
+  Storage::OpenProgress progress{0};
+  auto merge = [&](const scanned_pool_t& item) -> bool {
+    const PoolHash& hash = item.hash_;
     if(hash.is_empty())
     {
       set_last_error(Storage::DataIntegrityError, "Data integrity error: key '%s' is not a valid hash value",
-                     ::csdb::internal::to_hex(k).c_str());
+                     ::csdb::internal::to_hex(item.key_).c_str());
       return false;
     }
 
     // Сheck for hash matches in the key with the real hash of the block
-    PoolHash real_hash = PoolHash::calc_from_data(v);
-    if(hash != real_hash)
+    if(hash != item.real_hash_)
     {
       set_last_error(Storage::DataIntegrityError, "Data integrity error: key does not match real hash "
-                     "(key: '%s'; real hash: '%s')", hash.to_string().c_str(), real_hash.to_string().c_str());
+                     "(key: '%s'; real hash: '%s')", hash.to_string().c_str(), item.real_hash_.to_string().c_str());
       return false;
     }
 
-    Pool p = Pool::from_binary(v);
+    const Pool& p = item.pool_;
     if(!p.is_valid())
     {
       set_last_error(Storage::DataIntegrityError, "Data integrity error: Corrupted pool for key '%s'.",
@@ -163,6 +605,11 @@ bool Storage::priv::rescan(Storage::OpenCallback callback)
       return false;
     }
 
+    ::csdb::internal::byte_array header = header_key(hash);
+    if (!db->get(header)) {
+      missing_headers.emplace_back(::std::move(header), p.header_to_binary());
+    }
+
     update_heads_and_tails(heads, tails, hash, p.previous_hash());
     count_pool++;
     progress.poolsProcessed++;
@@ -172,6 +619,25 @@ bool Storage::priv::rescan(Storage::OpenCallback callback)
         return false;
       }
     }
+    return true;
+  };
+
+  bool merged = true;
+  scanned_pool_t item;
+  while (merged && queue.pop(item)) {
+    merged = merge(item);
+  }
+  queue.cancel();
+  for (auto& stage : stages) {
+    stage.join();
+  }
+  if (!merged) {
+    return false;
+  }
+
+  if (!missing_headers.empty() && !db->write_batch(missing_headers)) {
+    set_last_error(Storage::DatabaseError);
+    return false;
   }
 
   // Number of completed chains
@@ -185,6 +651,7 @@ bool Storage::priv::rescan(Storage::OpenCallback callback)
           return false;
 
         last_hash = it.first;
+        chain_length = it.second.len_;
       }
       return true;
     }()) {
@@ -209,6 +676,404 @@ bool Storage::priv::rescan(Storage::OpenCallback callback)
   return false;
 }
 
+bool Storage::priv::restore_checkpoint()
+{
+  ::csdb::internal::byte_array data;
+  if (!read_service_record(*db, service_key(ChainStateRecord), data)) {
+    return false;
+  }
+
+  chain_state_t state;
+  ::csdb::priv::ibstream is(data.data(), data.size());
+  if (data.empty() || !state.get(is)) {
+    return false;
+  }
+
+  // The tip must be in place, otherwise the storage is scanned again
+  if (state.last_hash_.is_empty() ? (0 != state.count_pool_)
+                                  : !read_service_record(*db, header_key(state.last_hash_), data)) {
+    return false;
+  }
+
+  last_hash = state.last_hash_;
+  count_pool = state.count_pool_;
+  chain_length = state.count_pool_;
+  return true;
+}
+
+::csdb::internal::byte_array Storage::priv::checkpoint(const PoolHash& hash, size_t count, size_t length) const
+{
+  // An empty record forces the rescan on the next opening
+  if (count != length) {
+    return ::csdb::internal::byte_array{};
+  }
+
+  chain_state_t state;
+  state.last_hash_ = hash;
+  state.count_pool_ = count;
+  ::csdb::priv::obstream os;
+  state.put(os);
+  return os.buffer();
+}
+
+bool Storage::priv::read_account(const ::csdb::internal::byte_array& key, accounts_t& accounts)
+{
+  if (accounts.end() != accounts.find(key)) {
+    return true;
+  }
+
+  account_t& acc = accounts[key];
+  ::csdb::internal::byte_array data;
+  if (!db->get(key, &data)) {
+    return (Database::NotFound == db->last_error());
+  }
+
+  ::csdb::priv::ibstream is(data.data(), data.size());
+  if (!acc.get(is)) {
+    set_last_error(Storage::DataIntegrityError, "Data integrity error: Corrupted account record '%s'.",
+                   ::csdb::internal::to_hex(key).c_str());
+    return false;
+  }
+  return true;
+}
+
+bool Storage::priv::apply_accounts(const Pool& pool, accounts_t& accounts)
+{
+  // Same rules BlockChain::getBalance used while walking the chain: the last
+  // outgoing transaction of a pool fixes the balance, every incoming amount
+  // of the pool is added on top of it.
+  struct pool_account_t
+  {
+    bool sent_ = false;
+    Amount sent_balance_;
+    Amount received_;
+    Amount delta_;
+  };
+  std::map<::csdb::internal::byte_array, pool_account_t> changes;
+
+  for (size_t i = 0; i < pool.transactions_count(); ++i) {
+    const Transaction t = pool.transaction(i);
+    const Currency currency = t.currency();
+    pool_account_t& src = changes[account_key(t.source(), currency)];
+    src.sent_ = true;
+    src.sent_balance_ = t.balance();
+    src.delta_ -= t.amount();
+
+    pool_account_t& dst = changes[account_key(t.target(), currency)];
+    dst.delta_ += t.amount();
+    if (t.target() != t.source()) {
+      dst.received_ += t.amount();
+    }
+  }
+
+  for (const auto& it : changes) {
+    if (!read_account(it.first, accounts)) {
+      return false;
+    }
+    account_t& acc = accounts[it.first];
+    acc.amount_ += it.second.delta_;
+    if (it.second.sent_) {
+      acc.balance_ = it.second.sent_balance_ + it.second.received_;
+    } else {
+      acc.balance_ += it.second.received_;
+    }
+  }
+  return true;
+}
+
+void Storage::priv::put_accounts(const accounts_t& accounts, Database::ItemList& items) const
+{
+  for (const auto& it : accounts) {
+    ::csdb::priv::obstream os;
+    it.second.put(os);
+    items.emplace_back(it.first, os.buffer());
+  }
+}
+
+void Storage::priv::put_postings(const Pool& pool, Database::ItemList& items) const
+{
+  std::map<::csdb::internal::byte_array, posting_t> postings;
+  for (size_t i = 0; i < pool.transactions_count(); ++i) {
+    const Transaction t = pool.transaction(i);
+    posting_t& src = postings[posting_key(t.source(), pool.sequence(), static_cast<uint32_t>(i))];
+    src.pool_hash_ = pool.hash();
+    src.flags_ |= PostingSource;
+    posting_t& dst = postings[posting_key(t.target(), pool.sequence(), static_cast<uint32_t>(i))];
+    dst.pool_hash_ = pool.hash();
+    dst.flags_ |= PostingTarget;
+  }
+
+  for (const auto& it : postings) {
+    ::csdb::priv::obstream os;
+    it.second.put(os);
+    items.emplace_back(it.first, os.buffer());
+  }
+}
+
+bool Storage::priv::drop_records(ServiceRecord type)
+{
+  const ::csdb::internal::byte_array prefix = service_key(type);
+  std::vector<::csdb::internal::byte_array> stale;
+  Database::IteratorPtr it = db->new_iterator();
+  for (it->seek(prefix); it->is_valid() && has_prefix(it->key(), prefix); it->next()) {
+    stale.push_back(it->key());
+  }
+  for (const auto& key : stale) {
+    if (!db->remove(key)) {
+      set_last_error(Storage::DatabaseError);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Storage::priv::sync_indexes()
+{
+  if (indexed_hash == last_hash) {
+    return true;
+  }
+
+  // Collect the part of the chain that has not been applied yet
+  std::vector<PoolHash> pending;
+  PoolHash hash = last_hash;
+  ::csdb::internal::byte_array data;
+  while ((!hash.is_empty()) && (hash != indexed_hash)) {
+    size_t cnt;
+    const Pool meta = load_meta(hash, cnt);
+    if (!meta.is_valid()) {
+      return false;
+    }
+    pending.push_back(hash);
+    hash = meta.previous_hash();
+  }
+
+  // The tables do not belong to this chain, rebuild them from the first pool
+  if (hash.is_empty()) {
+    if (!drop_records(AccountRecord) || !drop_records(TransactionIndexRecord) || !drop_records(HeightRecord)) {
+      return false;
+    }
+  }
+
+  // Postings and main chain records are idempotent and are flushed as they go, the account table
+  // and the state record are written last.
+  static const size_t POSTINGS_BATCH_SIZE = 4096;
+  accounts_t accounts;
+  Database::ItemList items;
+  for (auto it = pending.rbegin(); it != pending.rend(); ++it) {
+    if (!db->get(it->to_binary(), &data)) {
+      set_last_error(Storage::DatabaseError);
+      return false;
+    }
+    Pool pool = Pool::from_binary(data);
+    if (!pool.is_valid()) {
+      set_last_error(Storage::DataIntegrityError, "%s: Error decoding pool [hash: %s]", __func__, it->to_string().c_str());
+      return false;
+    }
+    if (!apply_accounts(pool, accounts)) {
+      return false;
+    }
+    put_postings(pool, items);
+    items.emplace_back(height_key(pool.sequence()), it->to_binary());
+    if (POSTINGS_BATCH_SIZE <= items.size()) {
+      if (!db->write_batch(items)) {
+        set_last_error(Storage::DatabaseError);
+        return false;
+      }
+      items.clear();
+    }
+  }
+
+  put_accounts(accounts, items);
+  items.emplace_back(service_key(IndexStateRecord), last_hash.to_binary());
+  if (!db->write_batch(items)) {
+    set_last_error(Storage::DatabaseError);
+    return false;
+  }
+
+  indexed_hash = last_hash;
+  return true;
+}
+
+// The indexes are brought up to date by open() and pool_save(), the readers only check them
+bool Storage::priv::indexes_synced()
+{
+  if (indexed_hash != last_hash) {
+    set_last_error(Storage::DataIntegrityError, "%s: Indexes are behind the chain [indexed: %s, last: %s]", __func__,
+                   indexed_hash.to_string().c_str(), last_hash.to_string().c_str());
+    return false;
+  }
+  return true;
+}
+
+template<typename F>
+bool Storage::priv::for_each_posting(const Address& addr, const ::csdb::internal::byte_array& from, size_t skip, F func)
+{
+  const ::csdb::internal::byte_array prefix = posting_key(addr);
+  Database::IteratorPtr it = db->new_iterator();
+
+  if (from.empty()) {
+    ::csdb::internal::byte_array end = prefix;
+    end.resize(prefix.size() + sizeof(uint64_t) + sizeof(uint32_t) + 1, 0xFF);
+    it->seek(end);
+  }
+  else {
+    it->seek(from);
+  }
+  if (it->is_valid()) {
+    it->prev();
+  }
+  else {
+    it->seek_to_last();
+  }
+
+  for (; it->is_valid(); it->prev()) {
+    const ::csdb::internal::byte_array k = it->key();
+    if (!has_prefix(k, prefix) || (k.size() != prefix.size() + sizeof(uint64_t) + sizeof(uint32_t))) {
+      break;
+    }
+    if (0 < skip) {
+      --skip;
+      continue;
+    }
+    const ::csdb::internal::byte_array v = it->value();
+    posting_t posting;
+    ::csdb::priv::ibstream is(v.data(), v.size());
+    if (!posting.get(is)) {
+      set_last_error(Storage::DataIntegrityError, "Data integrity error: Corrupted transaction index record '%s'.",
+                     ::csdb::internal::to_hex(k).c_str());
+      return false;
+    }
+    const uint32_t index = get_big_endian<uint32_t>(k.data() + prefix.size() + sizeof(uint64_t));
+    if (!func(posting.pool_hash_, index, posting.flags_)) {
+      break;
+    }
+  }
+  return true;
+}
+
+Pool Storage::priv::load(const PoolHash& hash, const Storage& owner)
+{
+  Pool pool;
+  if (cache.get(hash, pool)) {
+    return pool;
+  }
+
+  ::csdb::internal::byte_array data;
+  if (!db->get(hash.to_binary(), &data)) {
+    set_last_error(Storage::DatabaseError);
+    return Pool{};
+  }
+  pool = Pool::from_binary(data, use_arena);
+  if (!pool.is_valid()) {
+    set_last_error(Storage::DataIntegrityError, "%s: Error decoding pool [hash: %s]", __func__, hash.to_string().c_str());
+    return pool;
+  }
+  // Cached pools already know their storage, so Pool::load does not detach them
+  pool.set_storage(owner);
+  cache.put(hash, pool, data.size());
+  return pool;
+}
+
+PoolView Storage::priv::load_view(const PoolHash& hash)
+{
+  ::csdb::internal::byte_array data;
+  if (!db->get(hash.to_binary(), &data)) {
+    set_last_error(Storage::DatabaseError);
+    return PoolView{};
+  }
+  PoolView view = PoolView::from_binary(hash, ::std::move(data));
+  if (!view.is_valid()) {
+    set_last_error(Storage::DataIntegrityError, "%s: Error decoding pool [hash: %s]", __func__, hash.to_string().c_str());
+  }
+  return view;
+}
+
+Pool Storage::priv::load_meta(const PoolHash& hash, size_t& cnt)
+{
+  // Pools saved before the header records were introduced are decoded from the full record,
+  // until the next rescan writes their headers
+  ::csdb::internal::byte_array data;
+  Pool meta;
+  if (db->get(header_key(hash), &data)) {
+    meta = Pool::header_from_binary(hash, data, cnt);
+  }
+  else if (db->get(hash.to_binary(), &data)) {
+    const Pool pool = Pool::from_binary(data);
+    if (pool.is_valid()) {
+      meta = Pool::header_from_binary(hash, pool.header_to_binary(), cnt);
+    }
+  }
+  else {
+    set_last_error(Storage::DatabaseError);
+    return Pool{};
+  }
+
+  if (!meta.is_valid()) {
+    set_last_error(Storage::DataIntegrityError, "%s: Error decoding pool [hash: %s]", __func__, hash.to_string().c_str());
+  }
+  return meta;
+}
+
+bool Storage::priv::collect_transactions(const Address& addr, const ::csdb::internal::byte_array& from, size_t skip,
+                                         size_t limit, std::vector<Transaction>& res)
+{
+  if (!indexes_synced()) {
+    return false;
+  }
+
+  if (0 == limit) {
+    set_last_error();
+    return true;
+  }
+
+  // Consecutive postings mostly share the pool, so the last one loaded is kept.
+  // Only the transactions of the address are decoded.
+  PoolView view;
+  bool loaded = true;
+  const bool walked = for_each_posting(addr, from, skip, [&](const PoolHash& hash, uint32_t index, uint8_t) {
+    if (!view.is_valid() || (view.hash() != hash)) {
+      view = load_view(hash);
+      loaded = view.is_valid();
+      if (!loaded) {
+        return false;
+      }
+    }
+    res.push_back(view.transaction(index));
+    return res.size() < limit;
+  });
+  if (!walked || !loaded) {
+    return false;
+  }
+
+  set_last_error();
+  return true;
+}
+
+Transaction Storage::priv::last_posting(const Address& addr, uint8_t flag)
+{
+  PoolHash pool_hash;
+  uint32_t index = 0;
+  if (!indexes_synced()
+      || !for_each_posting(addr, ::csdb::internal::byte_array{}, 0, [&](const PoolHash& hash, uint32_t i, uint8_t flags) {
+           if (0 == (flags & flag)) {
+             return true;
+           }
+           pool_hash = hash;
+           index = i;
+           return false;
+         })
+      || pool_hash.is_empty()) {
+    return Transaction{};
+  }
+
+  return load_view(pool_hash).transaction(index);
+}
+
+Storage::CacheStats Storage::cache_stats() const
+{
+  return d->cache.stats();
+}
+
 Storage::Storage() :
   d(::std::make_shared<priv>())
 {
@@ -277,17 +1142,30 @@ bool Storage::open(const OpenOptions &opt, OpenCallback callback)
   }
 
   d->db = opt.db;
+  d->cache.set_budget(opt.cache_size);
+  d->use_arena = opt.use_arena;
 
   if (!d->db->is_open()) {
     d->set_last_error(DatabaseError, "Error open database: %s", d->db->last_error_message().c_str());
     return false;
   }
 
-  if(!d->rescan(callback)) {
-    d->db.reset();
-    return false;
+  if (opt.verify || !d->restore_checkpoint()) {
+    if (!d->rescan(callback, opt.verify_threads)) {
+      d->db.reset();
+      return false;
+    }
+    if (!d->db->put(service_key(ChainStateRecord), d->checkpoint(d->last_hash, d->count_pool, d->chain_length))) {
+      d->set_last_error(DatabaseError);
+      d->db.reset();
+      return false;
+    }
   }
 
+  ::csdb::internal::byte_array state;
+  d->indexed_hash = read_service_record(*d->db, service_key(IndexStateRecord), state) ? PoolHash::from_binary(state) : PoolHash{};
+  d->sync_indexes();
+
   d->set_last_error();
   return true;
 }
@@ -308,6 +1186,7 @@ bool Storage::open(const ::std::string& path_to_base, OpenCallback callback)
 void Storage::close()
 {
   d->db.reset();
+  d->cache.clear();
   d->set_last_error();
 }
 
@@ -351,11 +1230,44 @@ bool Storage::pool_save(Pool pool)
     return false;
   }
 
-  d->db->put(hash.to_binary(), pool.to_binary());
+  // Every pool gets its header, while the account table and the indexes follow
+  // the main chain. All of them are written in the same batch as the pool.
+  Database::ItemList items;
+  items.emplace_back(hash.to_binary(), pool.to_binary());
+  items.emplace_back(header_key(hash), pool.header_to_binary());
+
+  const bool is_next = (d->last_hash == pool.previous_hash());
+  const size_t count = d->count_pool + 1;
+  const size_t length = is_next ? (d->chain_length + 1) : d->chain_length;
+  items.emplace_back(service_key(ChainStateRecord), d->checkpoint(is_next ? hash : d->last_hash, count, length));
+
+  bool indexed = false;
+  if (is_next && (d->indexed_hash == d->last_hash)) {
+    accounts_t accounts;
+    indexed = d->apply_accounts(pool, accounts);
+    if (indexed) {
+      d->put_accounts(accounts, items);
+      d->put_postings(pool, items);
+      items.emplace_back(height_key(pool.sequence()), hash.to_binary());
+      items.emplace_back(service_key(IndexStateRecord), hash.to_binary());
+    }
+  }
 
-  d->count_pool++;
-  if (d->last_hash == pool.previous_hash()) {
+  if (!d->db->write_batch(items)) {
+    d->set_last_error(DatabaseError);
+    return false;
+  }
+
+  d->count_pool = count;
+  d->chain_length = length;
+  if (is_next) {
     d->last_hash = hash;
+    if (indexed) {
+      d->indexed_hash = hash;
+    }
+    else {
+      d->sync_indexes();
+    }
   }
   d->set_last_error();
   return true;
@@ -374,20 +1286,41 @@ Pool Storage::pool_load(const PoolHash &hash) const
     return Pool{};
   }
 
-  ::csdb::internal::byte_array data;
-  if (!d->db->get(hash.to_binary(), &data)) {
-    d->set_last_error(DatabaseError);
-    return Pool{};
+  Pool res = d->load(hash, *this);
+  if (res.is_valid()) {
+    d->set_last_error();
   }
+  return res;
+}
 
-  Pool res = Pool::from_binary(data);
-  if (!res.is_valid()) {
-    d->set_last_error(DataIntegrityError, "%s: Error decoding pool [hash: %s]", __func__, hash.to_string().c_str());
+PoolHash Storage::hash_at(uint64_t sequence) const
+{
+  if (!isOpen()) {
+    d->set_last_error(NotOpen);
+    return PoolHash{};
   }
-  else {
-    d->set_last_error();
+
+  if (!d->indexes_synced()) {
+    return PoolHash{};
   }
-  return res;
+
+  ::csdb::internal::byte_array data;
+  if (!d->db->get(height_key(sequence), &data)) {
+    d->set_last_error(InvalidParameter, "%s: No pool with sequence %" PRIu64, __func__, sequence);
+    return PoolHash{};
+  }
+
+  d->set_last_error();
+  return PoolHash::from_binary(data);
+}
+
+Pool Storage::pool_load(uint64_t sequence) const
+{
+  const PoolHash hash = hash_at(sequence);
+  if (hash.is_empty()) {
+    return Pool{};
+  }
+  return pool_load(hash);
 }
 
 Pool Storage::pool_load_meta(const PoolHash &hash, size_t& cnt) const
@@ -403,17 +1336,8 @@ Pool Storage::pool_load_meta(const PoolHash &hash, size_t& cnt) const
 		return Pool{};
 	}
 
-	::csdb::internal::byte_array data;
-	if (!d->db->get(hash.to_binary(), &data)) {
-		d->set_last_error(DatabaseError);
-		return Pool{};
-	}
-
-	Pool res = Pool::meta_from_binary(data, cnt);
-	if (!res.is_valid()) {
-		d->set_last_error(DataIntegrityError, "%s: Error decoding pool [hash: %s]", __func__, hash.to_string().c_str());
-	}
-	else {
+	Pool res = d->load_meta(hash, cnt);
+	if (res.is_valid()) {
 		d->set_last_error();
 	}
 
@@ -422,78 +1346,71 @@ Pool Storage::pool_load_meta(const PoolHash &hash, size_t& cnt) const
 
 Wallet Storage::wallet(const Address &addr) const
 {
-  return Wallet::get(addr);
+  return Wallet::get(addr, *this);
 }
 
-std::vector<Transaction> Storage::transactions(const Address &addr, size_t limit, const TransactionID &offset) const
+bool Storage::accounts(const Address &addr, ::std::map<Currency, Amount> &amounts, ::std::map<Currency, Amount> &balances) const
 {
-  std::vector<Transaction> res;
-  res.reserve(limit);
-
-  Pool curPool;
-  TransactionID::sequence_t curIdx = 0;
+  if (!isOpen()) {
+    d->set_last_error(NotOpen);
+    return false;
+  }
 
-  auto seekIt = [this, &curPool, &curIdx](const TransactionID &id) -> bool {
-    if(id.is_valid())
-    {
-      curPool = pool_load(id.pool_hash());
-      if(curPool.is_valid() && id.index() < curPool.transactions_count())
-      {
-        curIdx = id.index();
-        return true;
-      }
-    }
+  if (!d->indexes_synced()) {
     return false;
-  };
+  }
 
-  auto nextIt = [this, &curPool, &curIdx]() -> bool {
-    if(curPool.is_valid())
-    {
-      if(curIdx)
-      {
-        curIdx--;
-        return true;
-      }
-      else
-      {
-		  do {
-			  curPool = pool_load(curPool.previous_hash());
-		  } while (curPool.is_valid() && !(curPool.transactions_count()));
-        if(curPool.is_valid())
-        {
-          curIdx = static_cast<TransactionID::sequence_t>(curPool.transactions_count() - 1);
-          return true;
-        }
-      }
+  const ::csdb::internal::byte_array prefix = account_key(addr);
+  Database::IteratorPtr it = d->db->new_iterator();
+  for (it->seek(prefix); it->is_valid() && has_prefix(it->key(), prefix); it->next()) {
+    const ::csdb::internal::byte_array k = it->key();
+    const ::csdb::internal::byte_array v = it->value();
+    account_t acc;
+    ::csdb::priv::ibstream is(v.data(), v.size());
+    if (!acc.get(is)) {
+      d->set_last_error(DataIntegrityError, "%s: Corrupted account record '%s'", __func__, ::csdb::internal::to_hex(k).c_str());
+      return false;
     }
-    else
-    {
-      curPool = pool_load(last_hash());
-	  while (curPool.is_valid() && !(curPool.transactions_count())) {
-		  curPool = pool_load(curPool.previous_hash());
-	  }
+    const Currency currency(::std::string(k.begin() + prefix.size(), k.end()));
+    amounts[currency] = acc.amount_;
+    balances[currency] = acc.balance_;
+  }
 
-      if(curPool.is_valid())
-      {
-        curIdx = static_cast<TransactionID::sequence_t>(curPool.transactions_count() - 1);
-        return true;
-      }
-    }
-    return false;
-  };
+  d->set_last_error();
+  return true;
+}
 
-  if(offset.is_valid())
-    if(!seekIt(offset))
+std::vector<Transaction> Storage::transactions(const Address &addr, size_t limit, const TransactionID &offset) const
+{
+  std::vector<Transaction> res;
+  if (!isOpen()) {
+    d->set_last_error(NotOpen);
+    return res;
+  }
+
+  // The offset is exclusive, so the walk starts right below its posting
+  ::csdb::internal::byte_array from;
+  if (offset.is_valid()) {
+    size_t cnt;
+    const Pool meta = pool_load_meta(offset.pool_hash(), cnt);
+    if (!meta.is_valid() || (cnt <= offset.index())) {
       return res;
+    }
+    from = posting_key(addr, meta.sequence(), static_cast<uint32_t>(offset.index()));
+  }
 
-  while(res.size() < limit && nextIt())
-  {
-    const Transaction t = curPool.transaction(curIdx);
-    if((t.source() == addr) || (t.target() == addr))
-      res.push_back(t);
+  return d->collect_transactions(addr, from, 0, limit, res) ? res : std::vector<Transaction>{};
+}
+
+std::vector<Transaction> Storage::transactions(const Address &addr, size_t limit, size_t skip) const
+{
+  std::vector<Transaction> res;
+  if (!isOpen()) {
+    d->set_last_error(NotOpen);
+    return res;
   }
 
-  return res;
+  return d->collect_transactions(addr, ::csdb::internal::byte_array{}, skip, limit, res) ? res : std::vector<Transaction>{};
 }
 
 Transaction Storage::transaction(const TransactionID &id) const
@@ -503,39 +1420,55 @@ Transaction Storage::transaction(const TransactionID &id) const
     return Transaction{};
   }
 
-  return pool_load(id.pool_hash()).transaction(id);
+  if (!isOpen()) {
+    d->set_last_error(NotOpen);
+    return Transaction{};
+  }
+
+  // A pool that is not cached is not decoded for the sake of one transaction
+  Pool pool;
+  if (d->cache.get(id.pool_hash(), pool)) {
+    d->set_last_error();
+    // The transaction may outlive the cached pool, so it does not keep the pool arena
+    return d->use_arena ? pool.transaction(id).clone() : pool.transaction(id);
+  }
+
+  const PoolView view = d->load_view(id.pool_hash());
+  if (!view.is_valid()) {
+    return Transaction{};
+  }
+  d->set_last_error();
+  return view.transaction(id);
 }
 
-Transaction Storage::get_last_by_source(Address source) const noexcept
+PoolView Storage::pool_view(const PoolHash &hash) const
 {
-  Pool curr = pool_load(last_hash());
+  if (!isOpen()) {
+    d->set_last_error(NotOpen);
+    return PoolView{};
+  }
 
-  while (curr.is_valid())
+  if(hash.is_empty())
   {
-    const auto& t = curr.get_last_by_source(source);
-    if (t.is_valid())
-      return t;
+    d->set_last_error(InvalidParameter, "%s: Empty hash passed", __func__);
+    return PoolView{};
+  }
 
-    curr = pool_load(curr.previous_hash());
+  PoolView res = d->load_view(hash);
+  if (res.is_valid()) {
+    d->set_last_error();
   }
+  return res;
+}
 
-  return Transaction{};
+Transaction Storage::get_last_by_source(Address source) const noexcept
+{
+  return d->last_posting(source, PostingSource);
 }
 
 Transaction Storage::get_last_by_target(Address target) const noexcept
 {
-  Pool curr = pool_load(last_hash());
-
-  while (curr.is_valid())
-  {
-    const auto& t = curr.get_last_by_target(target);
-    if (t.is_valid())
-      return t;
-
-    curr = pool_load(curr.previous_hash());
-  }
-
-  return Transaction{};
+  return d->last_posting(target, PostingTarget);
 }
 
 }
@@ -220,6 +220,19 @@ UserField Transaction::user_field(user_field_id_t id) const noexcept
   return os.buffer();
 }
 
+Transaction Transaction::clone() const
+{
+  const priv* data = d.constData();
+  priv* p = new priv(*data);
+  for (auto& it : p->user_fields_) {
+    it.second = it.second.clone();
+  }
+  if (data->read_only_) {
+    p->_update_id(data->id_.d->pool_hash_, data->id_.d->index_);
+  }
+  return Transaction(p);
+}
+
 Transaction Transaction::from_binary(const ::csdb::internal::byte_array data)
 {
   Transaction t;
@@ -243,6 +256,15 @@ Transaction Transaction::from_byte_stream(const char* data, size_t m_size) {
   }
 }
 
+Transaction Transaction::from_byte_stream(const ::csdb::internal::byte_span* spans, size_t count) {
+  Transaction t;
+  ::csdb::priv::ibstream is(spans, count);
+  if (!t.get(is)) {
+    return Transaction();
+  }
+  return t;
+}
+
 std::vector<uint8_t> Transaction::to_byte_stream() const {
 	::csdb::priv::obstream os;
 	put(os);
@@ -272,4 +294,22 @@ bool Transaction::get(::csdb::priv::ibstream &is)
       && is.get(data->user_fields_);
 }
 
+bool Transaction::skip(::csdb::priv::ibstream &is)
+{
+  // Follows the layout read by get(): source, target, currency, amount, balance, user fields
+  Amount amount;
+  size_t count;
+  if (!is.skip_bytes() || !is.skip_bytes() || !is.skip_bytes()
+      || !is.get(amount) || !is.get(amount) || !is.get(count)) {
+    return false;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    user_field_id_t id;
+    if (!is.get(id) || !UserField::skip(is)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 } // namespace csdb
@@ -83,6 +83,7 @@ class Transaction::priv : public ::csdb::internal::shared_data
 
   friend class Transaction;
   friend class Pool;
+  friend class PoolView;
   friend class ::csdb::internal::shared_data_ptr<priv>;
 };
 
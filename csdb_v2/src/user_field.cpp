@@ -175,4 +175,32 @@ bool UserField::get(::csdb::priv::ibstream &is)
   return d->get(is);
 }
 
+UserField UserField::clone() const
+{
+  return UserField(new priv(*d.constData()));
+}
+
+bool UserField::skip(::csdb::priv::ibstream &is)
+{
+  // Follows the layout read by priv::get()
+  Type type;
+  if (!is.get(type)) {
+    return false;
+  }
+  switch (type) {
+  case Integer: {
+    uint64_t value;
+    return is.get(value);
+  }
+  case String:
+    return is.skip_bytes();
+  case Amount: {
+    ::csdb::Amount value;
+    return is.get(value);
+  }
+  default:
+    return false;
+  }
+}
+
 } // namespace csdb
@@ -16,6 +16,7 @@ class Wallet::priv : public ::csdb::internal::shared_data
 
   Address address_;
   std::map<Currency, Amount> amounts_;
+  std::map<Currency, Amount> balances_;
 
   friend class Wallet;
 };
@@ -49,6 +50,12 @@ Amount Wallet::amount(Currency currency) const noexcept
   return (it != d->amounts_.end()) ? it->second : 0_c;
 }
 
+Amount Wallet::balance(Currency currency) const noexcept
+{
+  const auto it = d->balances_.find(currency);
+  return (it != d->balances_.end()) ? it->second : 0_c;
+}
+
 Wallet Wallet::get(Address address, Storage storage)
 {
   if (!storage.isOpen()) {
@@ -59,17 +66,36 @@ Wallet Wallet::get(Address address, Storage storage)
   }
   priv *d = new priv(address);
 
+  if (storage.accounts(address, d->amounts_, d->balances_)) {
+    return Wallet(d);
+  }
+
+  // The account table is not available, fall back to walking the whole chain
+  d->amounts_.clear();
+  d->balances_.clear();
+  std::map<Currency, bool> closed;
   for (Pool pool = Pool::load(storage.last_hash(), storage);
        pool.is_valid();
        pool = Pool::load(pool.previous_hash(), storage)) {
+    std::map<Currency, Amount> sent;
     for (size_t i = 0; i < pool.transactions_count(); ++i) {
       const Transaction t = pool.transaction(i);
       const Currency currency = t.currency();
       if (t.source() == address) {
         d->amounts_[currency] -= t.amount();
+        sent[currency] = t.balance();
       }
       if (t.target() == address) {
         d->amounts_[currency] += t.amount();
+        if ((t.source() != address) && (!closed[currency])) {
+          d->balances_[currency] += t.amount();
+        }
+      }
+    }
+    for (const auto &it : sent) {
+      if (!closed[it.first]) {
+        d->balances_[it.first] += it.second;
+        closed[it.first] = true;
       }
     }
   }
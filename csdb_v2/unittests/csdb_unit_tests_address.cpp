@@ -1,5 +1,7 @@
 #include "csdb/address.h"
 
+#include <unordered_set>
+
 #include <gtest/gtest.h>
 
 #include "priv_crypto.h"
@@ -81,3 +83,31 @@ TEST_F(AddressTest, FromInvalidPublicKey)
   EXPECT_FALSE(Address::from_public_key(
                  ::csdb::internal::byte_array(::csdb::priv::crypto::public_key_size + 1)).is_valid());
 }
+
+TEST_F(AddressTest, Compare)
+{
+  Address a1 = Address::from_string("0000000000000000000000000000000000000001");
+  Address a2 = Address::from_string("0000000000000000000000000000000000000002");
+  Address a3 = a1;
+  EXPECT_EQ(a1, a3);
+  EXPECT_NE(a1, a2);
+  EXPECT_TRUE(a1 < a2);
+  EXPECT_FALSE(a2 < a1);
+  EXPECT_FALSE(a1 < a3);
+  EXPECT_TRUE(Address() < a1);
+  EXPECT_FALSE(a1 < Address());
+}
+
+TEST_F(AddressTest, StdUnorderedSet)
+{
+  ::std::unordered_set<Address> as;
+  EXPECT_TRUE(as.insert(Address::from_string("0000000000000000000000000000000000000001")).second);
+  EXPECT_FALSE(as.insert(Address::from_string("0000000000000000000000000000000000000001")).second);
+  EXPECT_TRUE(as.insert(Address::from_string("0000000000000000000000000000000000000002")).second);
+  EXPECT_TRUE(as.insert(Address()).second);
+  EXPECT_FALSE(as.insert(Address()).second);
+
+  EXPECT_EQ(as.size(), static_cast<size_t>(3));
+  EXPECT_EQ(as.count(Address::from_string("0000000000000000000000000000000000000002")), static_cast<size_t>(1));
+  EXPECT_EQ(as.count(Address::from_string("0000000000000000000000000000000000000003")), static_cast<size_t>(0));
+}
@@ -252,3 +252,65 @@ TEST_F(BinaryStreams, MapFilled)
   EXPECT_TRUE(i.empty());
   EXPECT_EQ(v1, v2);
 }
+
+TEST_F(BinaryStreams, Spans)
+{
+  ::std::map<int, ::std::string> m1;
+  m1.emplace(1, "Key1");
+  m1.emplace(1000000, ::std::string(300, 'x'));
+  Test t1{-100000, true, "Test string"};
+  uint64_t u1 = 0xFFFFFFFFFFFFull;
+
+  obstream o;
+  o.put(m1);
+  o.put(t1);
+  o.put(u1);
+  const ::csdb::internal::byte_array &s = o.buffer();
+
+  // Every split point of two spans, with an empty span on the border
+  for (size_t split = 0; split <= s.size(); ++split) {
+    const ::csdb::internal::byte_span spans[] = {
+      {s.data(), split},
+      {nullptr, 0},
+      {s.data() + split, s.size() - split}
+    };
+
+    ibstream i(spans, 3);
+    EXPECT_EQ(i.size(), s.size());
+
+    ::std::map<int, ::std::string> m2;
+    Test t2;
+    uint64_t u2;
+    EXPECT_TRUE(i.get(m2));
+    EXPECT_TRUE(i.get(t2));
+    EXPECT_TRUE(i.get(u2));
+    EXPECT_TRUE(i.empty());
+    EXPECT_FALSE(i.get(u2));
+
+    EXPECT_EQ(m1, m2);
+    EXPECT_EQ(t1, t2);
+    EXPECT_EQ(u1, u2);
+  }
+
+  // One byte per span
+  std::vector<::csdb::internal::byte_span> bytes;
+  for (size_t j = 0; j < s.size(); ++j) {
+    bytes.push_back({s.data() + j, 1});
+  }
+
+  ibstream i(bytes.data(), bytes.size());
+  ::std::map<int, ::std::string> m2;
+  Test t2;
+  uint64_t u2;
+  EXPECT_TRUE(i.get(m2) && i.get(t2) && i.get(u2));
+  EXPECT_TRUE(i.empty());
+  EXPECT_EQ(m1, m2);
+  EXPECT_EQ(t1, t2);
+  EXPECT_EQ(u1, u2);
+
+  // The data cut short
+  bytes.pop_back();
+  ibstream i1(bytes.data(), bytes.size());
+  EXPECT_TRUE(i1.get(m2) && i1.get(t2));
+  EXPECT_FALSE(i1.get(u2));
+}
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <set>
 #include <map>
+#include <unordered_set>
 #include <stdexcept>
 
 #include <gtest/gtest.h>
@@ -129,6 +130,22 @@ TEST_F(PoolHashTest, StdMap)
   EXPECT_EQ(hm.at(PoolHash{}), (internal::byte_array{}));
 }
 
+TEST_F(PoolHashTest, StdUnorderedSet)
+{
+  ::std::unordered_set<PoolHash> hs;
+  EXPECT_TRUE(hs.insert(PoolHash::calc_from_data({1,2,3})).second);
+  EXPECT_FALSE(hs.insert(PoolHash::calc_from_data({1,2,3})).second);
+  EXPECT_TRUE(hs.insert(PoolHash::calc_from_data({1,2,4})).second);
+  EXPECT_TRUE(hs.insert(PoolHash{}).second);
+  EXPECT_FALSE(hs.insert(PoolHash{}).second);
+
+  EXPECT_EQ(hs.size(), static_cast<size_t>(3));
+  EXPECT_EQ(hs.count(PoolHash::calc_from_data({1,2,3})), static_cast<size_t>(1));
+  EXPECT_EQ(hs.count(PoolHash::calc_from_data({1,4,2})), static_cast<size_t>(0));
+  EXPECT_EQ(::std::hash<PoolHash>()(PoolHash::calc_from_data({1,2,3})),
+            ::std::hash<PoolHash>()(PoolHash::from_string(PoolHash::calc_from_data({1,2,3}).to_string())));
+}
+
 TEST_F(PoolHashTest, FromValidString)
 {
   {
@@ -512,6 +529,84 @@ TEST_F(PoolTest, FromToBinaryWithTransactions)
   }
 }
 
+TEST_F(PoolTest, FromBinaryArena)
+{
+  Pool src{PoolHash{}, 0};
+  for (int32_t i = 1; i <= 1000; ++i) {
+    Transaction t(addr1, addr2, Currency("RUB"), Amount(i));
+    EXPECT_TRUE(t.add_user_field(1, UserField("Comment")));
+    EXPECT_TRUE(src.add_transaction(t, true));
+  }
+  EXPECT_TRUE(src.add_user_field(0, UserField("1520000000000")));
+  EXPECT_TRUE(src.compose());
+
+  Transaction last;
+  {
+    Pool dst = Pool::from_binary(src.to_binary(), true);
+    EXPECT_TRUE(dst.is_valid());
+    EXPECT_TRUE(dst.is_read_only());
+    EXPECT_EQ(src, dst);
+    EXPECT_EQ(dst.user_field(0), src.user_field(0));
+    for (size_t i = 0; i < dst.transactions_count(); ++i) {
+      EXPECT_EQ(dst.transaction(i), src.transaction(i));
+      EXPECT_EQ(dst.transaction(i).id(), src.transaction(i).id());
+    }
+    last = dst.transaction(dst.transactions_count() - 1);
+  }
+
+  // A transaction taken from the pool keeps the arena alive
+  EXPECT_EQ(last, src.transaction(src.transactions_count() - 1));
+  EXPECT_EQ(last.amount(), 1000_c);
+  EXPECT_EQ(last.user_field(1).value<std::string>(), "Comment");
+
+  // A copy made outside of the arena outlives it
+  Pool next{PoolHash{}, 1};
+  EXPECT_TRUE(next.add_transaction(last, true));
+  last = Transaction{};
+  EXPECT_EQ(next.transaction(0).amount(), 1000_c);
+  EXPECT_EQ(next.transaction(0).user_field(1).value<std::string>(), "Comment");
+
+  EXPECT_FALSE(Pool::from_binary(::csdb::internal::byte_array{1, 2, 3}, true).is_valid());
+  ::csdb::internal::byte_array truncated = src.to_binary();
+  truncated.resize(truncated.size() / 2);
+  EXPECT_FALSE(Pool::from_binary(truncated, true).is_valid());
+}
+
+TEST_F(PoolTest, FromByteStreamSpans)
+{
+  Pool src{PoolHash{}, 0};
+  for (int32_t i = 1; i <= 100; ++i) {
+    Transaction t(addr1, addr2, Currency("RUB"), Amount(i));
+    EXPECT_TRUE(t.add_user_field(1, UserField("Comment")));
+    EXPECT_TRUE(src.add_transaction(t, true));
+  }
+  EXPECT_TRUE(src.add_user_field(0, UserField("1520000000000")));
+  EXPECT_TRUE(src.compose());
+
+  const ::csdb::internal::byte_array binary = src.to_binary();
+
+  // Split like a network message into fragments of the same size
+  for (size_t fragment : {1, 7, 64, 1000}) {
+    std::vector<::csdb::internal::byte_span> spans;
+    for (size_t offset = 0; offset < binary.size(); offset += fragment) {
+      spans.push_back({binary.data() + offset, std::min(fragment, binary.size() - offset)});
+    }
+
+    Pool dst = Pool::from_byte_stream(spans.data(), spans.size());
+    ASSERT_TRUE(dst.is_valid());
+    EXPECT_EQ(dst.user_field(0), src.user_field(0));
+    ASSERT_EQ(dst.transactions_count(), src.transactions_count());
+    for (size_t i = 0; i < dst.transactions_count(); ++i) {
+      EXPECT_EQ(dst.transaction(i).amount(), src.transaction(i).amount());
+      EXPECT_EQ(dst.transaction(i).user_field(1), src.transaction(i).user_field(1));
+    }
+
+    // A message cut short
+    spans.pop_back();
+    EXPECT_FALSE(Pool::from_byte_stream(spans.data(), spans.size()).is_valid());
+  }
+}
+
 TEST_F(PoolTest, UserFieldCompare)
 {
   Pool p1{PoolHash{}, 0}, p2{PoolHash{}, 0};
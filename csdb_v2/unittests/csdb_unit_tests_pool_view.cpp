@@ -0,0 +1,68 @@
+#include "csdb/pool_view.h"
+
+#include <gtest/gtest.h>
+
+#include "csdb_unit_tests_environment.h"
+
+using namespace csdb;
+
+class PoolViewTest : public ::testing::Test
+{
+protected:
+  ::csdb::Address addr1 = ::csdb::Address::from_string("0000000000000000000000000000000000000000");
+  ::csdb::Address addr2 = ::csdb::Address::from_string("0000000000000000000000000000000000000001");
+  ::csdb::Address addr3 = ::csdb::Address::from_string("0000000000000000000000000000000000000002");
+};
+
+TEST_F(PoolViewTest, Empty)
+{
+  PoolView v;
+  EXPECT_FALSE(v.is_valid());
+  EXPECT_EQ(v.transactions_count(), static_cast<size_t>(0));
+  EXPECT_FALSE(v.transaction(0).is_valid());
+
+  v = PoolView::from_binary(PoolHash{}, ::csdb::internal::byte_array{1, 2, 3});
+  EXPECT_FALSE(v.is_valid());
+}
+
+TEST_F(PoolViewTest, SameAsPool)
+{
+  Pool p{PoolHash::calc_from_data({1}), 7};
+  Transaction t1(addr1, addr2, Currency("RUB"), 10_c, 100_c);
+  ASSERT_TRUE(t1.add_user_field(1, UserField(12)));
+  ASSERT_TRUE(t1.add_user_field(2, UserField("Comment")));
+  ASSERT_TRUE(t1.add_user_field(3, UserField(1.5_c)));
+  ASSERT_TRUE(p.add_transaction(t1, true));
+  ASSERT_TRUE(p.add_transaction(Transaction(addr2, addr3, Currency("USD"), 0.01_c), true));
+  ASSERT_TRUE(p.add_transaction(Transaction(addr3, addr1, Currency("RUB"), 30_c), true));
+  ASSERT_TRUE(p.add_user_field(0, UserField("1520000000000")));
+  ASSERT_TRUE(p.compose());
+
+  PoolView v = PoolView::from_binary(p.hash(), p.to_binary());
+  ASSERT_TRUE(v.is_valid());
+  EXPECT_EQ(v.hash(), p.hash());
+  EXPECT_EQ(v.previous_hash(), p.previous_hash());
+  EXPECT_EQ(v.sequence(), p.sequence());
+  EXPECT_EQ(v.transactions_count(), p.transactions_count());
+  EXPECT_EQ(v.user_field_ids(), p.user_field_ids());
+  EXPECT_EQ(v.user_field(0), p.user_field(0));
+
+  for (size_t i = 0; i < p.transactions_count(); ++i) {
+    const Transaction t = v.transaction(i);
+    EXPECT_EQ(t, p.transaction(i));
+    EXPECT_EQ(t.id(), p.transaction(i).id());
+    EXPECT_EQ(t.user_field_ids(), p.transaction(i).user_field_ids());
+    EXPECT_EQ(v.transaction(t.id()), t);
+  }
+  EXPECT_FALSE(v.transaction(p.transactions_count()).is_valid());
+  EXPECT_FALSE(v.transaction(TransactionID(p.previous_hash(), 0)).is_valid());
+
+  const Pool copy = v.to_pool();
+  EXPECT_EQ(copy.hash(), p.hash());
+  EXPECT_EQ(copy.transactions_count(), p.transactions_count());
+
+  // A truncated binary is not a valid view
+  ::csdb::internal::byte_array data = p.to_binary();
+  data.resize(data.size() - 20);
+  EXPECT_FALSE(PoolView::from_binary(p.hash(), data).is_valid());
+}
@@ -3,6 +3,7 @@
 #include "csdb_unit_tests_environment.h"
 
 #include "csdb/wallet.h"
+#include "csdb/database_leveldb.h"
 #include "csdb/internal/utils.h"
 
 using namespace csdb;
@@ -292,4 +293,382 @@ TEST_F(StorageTestEmpty, GetTransactionBySourceAndTarget)
   ::csdb::Address addr4 = ::csdb::Address::from_string("0000000000000000000000000000000000000004");
   EXPECT_FALSE(s.get_last_by_source(addr4).is_valid());
   EXPECT_FALSE(s.get_last_by_target(addr4).is_valid());
-}
\ No newline at end of file
+}
+//
+// Transactions of the address
+//
+
+TEST_F(StorageTestEmpty, TransactionsOfAddress)
+{
+  Pool p1{PoolHash{}, 0};
+  ASSERT_TRUE(p1.add_transaction(Transaction(addr1, addr2, Currency("RUB"), 11_c), true));
+  ASSERT_TRUE(p1.add_transaction(Transaction(addr2, addr3, Currency("RUB"), 12_c), true));
+  ASSERT_TRUE(p1.add_transaction(Transaction(addr1, addr3, Currency("RUB"), 13_c), true));
+  ASSERT_TRUE(p1.compose());
+
+  Pool p2{p1.hash(), 1};
+  ASSERT_TRUE(p2.add_transaction(Transaction(addr2, addr3, Currency("RUB"), 21_c), true));
+  ASSERT_TRUE(p2.compose());
+
+  Pool p3{p2.hash(), 2};
+  ASSERT_TRUE(p3.add_transaction(Transaction(addr3, addr1, Currency("RUB"), 31_c), true));
+  ASSERT_TRUE(p3.add_transaction(Transaction(addr1, addr2, Currency("RUB"), 32_c), true));
+  ASSERT_TRUE(p3.compose());
+
+  {
+    Storage s;
+    ASSERT_TRUE(s.open(path_to_tests));
+    ASSERT_TRUE(s.pool_save(p1));
+    ASSERT_TRUE(s.pool_save(p2));
+    ASSERT_TRUE(s.pool_save(p3));
+
+    std::vector<Transaction> all = s.transactions(addr1);
+    ASSERT_EQ(all.size(), static_cast<size_t>(4));
+    EXPECT_EQ(all[0].amount(), 32_c);
+    EXPECT_EQ(all[1].amount(), 31_c);
+    EXPECT_EQ(all[2].amount(), 13_c);
+    EXPECT_EQ(all[3].amount(), 11_c);
+
+    std::vector<Transaction> page = s.transactions(addr1, 2, all[1].id());
+    ASSERT_EQ(page.size(), static_cast<size_t>(2));
+    EXPECT_EQ(page[0], all[2]);
+    EXPECT_EQ(page[1], all[3]);
+
+    page = s.transactions(addr1, 2, static_cast<size_t>(1));
+    ASSERT_EQ(page.size(), static_cast<size_t>(2));
+    EXPECT_EQ(page[0], all[1]);
+    EXPECT_EQ(page[1], all[2]);
+
+    EXPECT_TRUE(s.transactions(addr1, 2, static_cast<size_t>(4)).empty());
+    EXPECT_TRUE(s.transactions(addr1, 0).empty());
+    EXPECT_EQ(s.transactions(addr2).size(), static_cast<size_t>(4));
+  }
+
+  // The index catches up with pools saved out of order on reopening
+  ASSERT_TRUE(internal::path_remove(path_to_tests));
+  Storage s;
+  ASSERT_TRUE(s.open(path_to_tests));
+  ASSERT_TRUE(s.pool_save(p3));
+  ASSERT_TRUE(s.pool_save(p1));
+  ASSERT_TRUE(s.pool_save(p2));
+  EXPECT_EQ(s.transactions(addr3).size(), static_cast<size_t>(3));
+  s.close();
+  ASSERT_TRUE(s.open(path_to_tests));
+
+  std::vector<Transaction> all = s.transactions(addr3);
+  ASSERT_EQ(all.size(), static_cast<size_t>(4));
+  EXPECT_EQ(all[0].amount(), 31_c);
+  EXPECT_EQ(all[1].amount(), 21_c);
+  EXPECT_EQ(all[2].amount(), 13_c);
+  EXPECT_EQ(all[3].amount(), 12_c);
+  EXPECT_EQ(s.get_last_by_source(addr3).amount(), 31_c);
+  EXPECT_EQ(s.get_last_by_target(addr3).amount(), 21_c);
+}
+
+//
+// Pools by sequence
+//
+
+TEST_F(StorageTestEmpty, PoolBySequence)
+{
+  Pool p1{PoolHash{}, 0};
+  ASSERT_TRUE(p1.add_transaction(Transaction(addr1, addr2, Currency("RUB"), 11_c), true));
+  ASSERT_TRUE(p1.compose());
+
+  Pool p2{p1.hash(), 1};
+  ASSERT_TRUE(p2.compose());
+
+  Pool p3{p2.hash(), 2};
+  ASSERT_TRUE(p3.add_transaction(Transaction(addr2, addr3, Currency("RUB"), 31_c), true));
+  ASSERT_TRUE(p3.compose());
+
+  Storage s;
+  ASSERT_TRUE(s.open(path_to_tests));
+  EXPECT_TRUE(s.hash_at(0).is_empty());
+  EXPECT_EQ(s.last_error(), Storage::InvalidParameter);
+
+  ASSERT_TRUE(s.pool_save(p1));
+  ASSERT_TRUE(s.pool_save(p3));
+  EXPECT_EQ(s.hash_at(0), p1.hash());
+  EXPECT_TRUE(s.hash_at(2).is_empty());
+
+  ASSERT_TRUE(s.pool_save(p2));
+  s.close();
+  ASSERT_TRUE(s.open(path_to_tests));
+
+  EXPECT_EQ(s.hash_at(0), p1.hash());
+  EXPECT_EQ(s.hash_at(1), p2.hash());
+  EXPECT_EQ(s.hash_at(2), p3.hash());
+  EXPECT_EQ(s.last_error(), Storage::NoError);
+  EXPECT_TRUE(s.hash_at(3).is_empty());
+
+  Pool p = s.pool_load(2);
+  ASSERT_TRUE(p.is_valid());
+  EXPECT_EQ(p.hash(), p3.hash());
+  EXPECT_EQ(p.transaction(0).amount(), 31_c);
+  EXPECT_FALSE(s.pool_load(3).is_valid());
+}
+
+//
+// Pool headers
+//
+
+TEST_F(StorageTestEmpty, PoolHeader)
+{
+  Pool p1{PoolHash{}, 0};
+  ASSERT_TRUE(p1.add_transaction(Transaction(addr1, addr2, Currency("RUB"), 11_c), true));
+  ASSERT_TRUE(p1.add_transaction(Transaction(addr2, addr3, Currency("RUB"), 12_c), true));
+  ASSERT_TRUE(p1.add_user_field(0, UserField("1520000000000")));
+  ASSERT_TRUE(p1.compose());
+
+  Storage s;
+  ASSERT_TRUE(s.open(path_to_tests));
+  ASSERT_TRUE(s.pool_save(p1));
+  s.close();
+  ASSERT_TRUE(s.open(path_to_tests));
+
+  size_t cnt = 0;
+  Pool meta = s.pool_load_meta(p1.hash(), cnt);
+  ASSERT_TRUE(meta.is_valid());
+  EXPECT_EQ(s.last_error(), Storage::NoError);
+  EXPECT_EQ(cnt, static_cast<size_t>(2));
+  EXPECT_EQ(meta.hash(), p1.hash());
+  EXPECT_EQ(meta.previous_hash(), p1.previous_hash());
+  EXPECT_EQ(meta.sequence(), p1.sequence());
+  EXPECT_EQ(meta.user_field(0).value<std::string>(), "1520000000000");
+  EXPECT_EQ(meta.transactions_count(), static_cast<size_t>(0));
+
+  Pool p2{p1.hash(), 1};
+  ASSERT_TRUE(p2.compose());
+  EXPECT_FALSE(s.pool_load_meta(p2.hash(), cnt).is_valid());
+}
+
+TEST_F(StorageTestEmpty, PoolHeaderMissing)
+{
+  Pool p1{PoolHash{}, 0};
+  ASSERT_TRUE(p1.add_transaction(Transaction(addr1, addr2, Currency("RUB"), 11_c), true));
+  ASSERT_TRUE(p1.add_user_field(0, UserField("1520000000000")));
+  ASSERT_TRUE(p1.compose());
+
+  // The pool as it was stored before the header records
+  ::csdb::internal::byte_array header{0, 'P'};
+  const ::csdb::internal::byte_array hash = p1.hash().to_binary();
+  header.insert(header.end(), hash.begin(), hash.end());
+
+  Storage s;
+  {
+    auto db = ::std::make_shared<::csdb::DatabaseLevelDB>();
+    ASSERT_TRUE(db->open(path_to_tests));
+    ASSERT_TRUE(s.open(Storage::OpenOptions{db}));
+    ASSERT_TRUE(s.pool_save(p1));
+    ASSERT_TRUE(static_cast<::csdb::Database&>(*db).remove(header));
+  }
+
+  size_t cnt = 0;
+  Pool meta = s.pool_load_meta(p1.hash(), cnt);
+  ASSERT_TRUE(meta.is_valid());
+  EXPECT_EQ(cnt, static_cast<size_t>(1));
+  EXPECT_EQ(meta.hash(), p1.hash());
+  EXPECT_EQ(meta.sequence(), p1.sequence());
+  EXPECT_EQ(meta.user_field(0).value<std::string>(), "1520000000000");
+  s.close();
+
+  // The rescan writes the header back
+  auto db = ::std::make_shared<::csdb::DatabaseLevelDB>();
+  ASSERT_TRUE(db->open(path_to_tests));
+  ASSERT_TRUE(s.open(Storage::OpenOptions{db, true}));
+  EXPECT_TRUE(static_cast<::csdb::Database&>(*db).get(header));
+}
+
+//
+// Chain tip checkpoint
+//
+
+TEST_F(StorageTestEmpty, OpenFromCheckpoint)
+{
+  Pool p1{PoolHash{}, 0};
+  ASSERT_TRUE(p1.compose());
+  Pool p2{p1.hash(), 1};
+  ASSERT_TRUE(p2.compose());
+  Pool p3{p2.hash(), 2};
+  ASSERT_TRUE(p3.compose());
+
+  size_t processed = 0;
+  auto callback = [&processed](const Storage::OpenProgress&)
+  {
+    ++processed;
+    return false;
+  };
+
+  Storage s;
+  ASSERT_TRUE(s.open(path_to_tests));
+  ASSERT_TRUE(s.pool_save(p1));
+  ASSERT_TRUE(s.pool_save(p3));
+  s.close();
+
+  // A pool out of the main chain disables the checkpoint
+  ASSERT_TRUE(s.open(path_to_tests, callback));
+  EXPECT_EQ(processed, static_cast<size_t>(2));
+  EXPECT_EQ(s.last_hash(), p1.hash());
+  ASSERT_TRUE(s.pool_save(p2));
+  s.close();
+
+  processed = 0;
+  ASSERT_TRUE(s.open(path_to_tests, callback));
+  EXPECT_EQ(processed, static_cast<size_t>(3));
+  EXPECT_EQ(s.last_hash(), p3.hash());
+  EXPECT_EQ(s.size(), static_cast<size_t>(3));
+  s.close();
+
+  processed = 0;
+  ASSERT_TRUE(s.open(path_to_tests, callback));
+  EXPECT_EQ(processed, static_cast<size_t>(0));
+  EXPECT_EQ(s.last_hash(), p3.hash());
+  EXPECT_EQ(s.size(), static_cast<size_t>(3));
+  s.close();
+
+  auto db = ::std::make_shared<::csdb::DatabaseLevelDB>();
+  ASSERT_TRUE(db->open(path_to_tests));
+  ASSERT_TRUE(s.open(Storage::OpenOptions{db, true, 4}, callback));
+  EXPECT_EQ(processed, static_cast<size_t>(3));
+  EXPECT_EQ(s.last_hash(), p3.hash());
+}
+
+//
+// Parallel verification
+//
+
+TEST_F(StorageTestEmpty, ParallelVerification)
+{
+  Storage s;
+  ASSERT_TRUE(s.open(path_to_tests));
+  PoolHash prev;
+  for (Pool::sequence_t i = 0; i < 100; ++i) {
+    Pool p{prev, i};
+    ASSERT_TRUE(p.add_transaction(Transaction(addr1, addr2, Currency("RUB"), Amount(static_cast<int32_t>(i + 1))), true));
+    ASSERT_TRUE(p.compose());
+    ASSERT_TRUE(s.pool_save(p));
+    prev = p.hash();
+  }
+  const ::csdb::internal::byte_array last = s.pool_load(prev).to_binary();
+  s.close();
+
+  uint64_t processed = 0;
+  auto callback = [&processed](const Storage::OpenProgress& progress)
+  {
+    processed = progress.poolsProcessed;
+    return false;
+  };
+
+  for (size_t threads : {1, 3, 8}) {
+    auto db = ::std::make_shared<::csdb::DatabaseLevelDB>();
+    ASSERT_TRUE(db->open(path_to_tests));
+    processed = 0;
+    ASSERT_TRUE(s.open(Storage::OpenOptions{db, true, threads}, callback));
+    EXPECT_EQ(processed, static_cast<uint64_t>(100));
+    EXPECT_EQ(s.last_hash(), prev);
+    EXPECT_EQ(s.size(), static_cast<size_t>(100));
+    s.close();
+  }
+
+  // Cancelling stops the reader while the ring between the stages is full
+  {
+    auto db = ::std::make_shared<::csdb::DatabaseLevelDB>();
+    ASSERT_TRUE(db->open(path_to_tests));
+    processed = 0;
+    auto cancel = [&processed](const Storage::OpenProgress& progress)
+    {
+      processed = progress.poolsProcessed;
+      return 10 <= processed;
+    };
+    EXPECT_FALSE(s.open(Storage::OpenOptions{db, true, 1}, cancel));
+    EXPECT_EQ(s.last_error(), Storage::UserCancelled);
+    EXPECT_EQ(processed, static_cast<uint64_t>(10));
+  }
+
+  // A pool stored under a wrong key is reported
+  {
+    ::std::shared_ptr<::csdb::DatabaseLevelDB> db = ::std::make_shared<::csdb::DatabaseLevelDB>();
+    ASSERT_TRUE(db->open(path_to_tests));
+    ::csdb::internal::byte_array key = prev.to_binary();
+    key.back() ^= 0xFF;
+    ASSERT_TRUE(static_cast<::csdb::Database&>(*db).put(key, last));
+  }
+  auto db = ::std::make_shared<::csdb::DatabaseLevelDB>();
+  ASSERT_TRUE(db->open(path_to_tests));
+  EXPECT_FALSE(s.open(Storage::OpenOptions{db, true, 4}));
+  EXPECT_EQ(s.last_error(), Storage::DataIntegrityError);
+}
+
+//
+// Decoded pool cache
+//
+
+TEST_F(StorageTestEmpty, PoolCache)
+{
+  Pool p1{PoolHash{}, 0};
+  ASSERT_TRUE(p1.add_transaction(Transaction(addr1, addr2, Currency("RUB"), 11_c), true));
+  ASSERT_TRUE(p1.compose());
+  Pool p2{p1.hash(), 1};
+  ASSERT_TRUE(p2.add_transaction(Transaction(addr2, addr3, Currency("RUB"), 21_c), true));
+  ASSERT_TRUE(p2.compose());
+
+  Storage s;
+  ASSERT_TRUE(s.open(path_to_tests));
+  ASSERT_TRUE(s.pool_save(p1));
+  ASSERT_TRUE(s.pool_save(p2));
+
+  EXPECT_EQ(s.pool_load(p1.hash()), p1);
+  EXPECT_EQ(s.pool_load(p1.hash()), p1);
+  EXPECT_EQ(s.transaction(p1.transaction(0).id()), p1.transaction(0));
+
+  Storage::CacheStats stats = s.cache_stats();
+  EXPECT_EQ(stats.hits, static_cast<uint64_t>(2));
+  EXPECT_EQ(stats.misses, static_cast<uint64_t>(1));
+  EXPECT_EQ(stats.pools, static_cast<size_t>(1));
+  EXPECT_EQ(stats.bytes, p1.to_binary().size());
+  s.close();
+
+  // The budget fits only one of the pools
+  const size_t budget = ::std::max(p1.to_binary().size(), p2.to_binary().size());
+  auto db = ::std::make_shared<::csdb::DatabaseLevelDB>();
+  ASSERT_TRUE(db->open(path_to_tests));
+  ASSERT_TRUE(s.open(Storage::OpenOptions{db, false, 0, budget}));
+  EXPECT_EQ(s.pool_load(p1.hash()), p1);
+  EXPECT_EQ(s.pool_load(p2.hash()), p2);
+  EXPECT_EQ(s.pool_load(p1.hash()), p1);
+
+  stats = s.cache_stats();
+  EXPECT_EQ(stats.hits, static_cast<uint64_t>(0));
+  EXPECT_EQ(stats.misses, static_cast<uint64_t>(3));
+  EXPECT_EQ(stats.pools, static_cast<size_t>(1));
+}
+
+TEST_F(StorageTestEmpty, PoolCacheArena)
+{
+  Pool p1{PoolHash{}, 0};
+  Transaction t(addr1, addr2, Currency("RUB"), 11_c);
+  ASSERT_TRUE(t.add_user_field(1, UserField("Comment")));
+  ASSERT_TRUE(p1.add_transaction(t, true));
+  ASSERT_TRUE(p1.add_transaction(Transaction(addr2, addr3, Currency("RUB"), 21_c), true));
+  ASSERT_TRUE(p1.compose());
+
+  auto db = ::std::make_shared<::csdb::DatabaseLevelDB>();
+  ASSERT_TRUE(db->open(path_to_tests));
+  Storage s;
+  Storage::OpenOptions options{db};
+  options.use_arena = true;
+  ASSERT_TRUE(s.open(options));
+  ASSERT_TRUE(s.pool_save(p1));
+
+  EXPECT_EQ(s.pool_load(p1.hash()), p1);
+  EXPECT_EQ(s.cache_stats().pools, static_cast<size_t>(1));
+
+  // The transaction of the cached pool is a copy, which stays valid after the pool is gone
+  const Transaction loaded = s.transaction(p1.transaction(0).id());
+  s.close();
+  EXPECT_EQ(loaded, p1.transaction(0));
+  EXPECT_EQ(loaded.id(), p1.transaction(0).id());
+  EXPECT_TRUE(loaded.is_read_only());
+  EXPECT_EQ(loaded.user_field(1).value<std::string>(), "Comment");
+}
@@ -271,3 +271,39 @@ TEST_F(WalletTest, UnexistingAddress)
   EXPECT_TRUE(w.address().is_valid());
   EXPECT_EQ(w.currencies().size(), static_cast<size_t>(0));
 }
+
+TEST_F(WalletTest, Balance)
+{
+  Storage s;
+  ASSERT_TRUE(s.open(path_to_tests_));
+  ASSERT_TRUE(s.last_hash().is_empty());
+
+  Pool p{s.last_hash(), 0, s};
+  ASSERT_TRUE(p.add_transaction(Transaction(addr1, addr2, Currency("RUB"), 10_c, 100_c), true));
+  ASSERT_TRUE(p.add_transaction(Transaction(addr3, addr1, Currency("RUB"), 30_c, 50_c), true));
+  ASSERT_TRUE(p.compose());
+  ASSERT_TRUE(p.save());
+
+  p = Pool{p.hash(), p.sequence() + 1, p.storage()};
+  ASSERT_TRUE(p.add_transaction(Transaction(addr2, addr1, Currency("RUB"), 5_c, 10_c), true));
+  ASSERT_TRUE(p.add_transaction(Transaction(addr2, addr3, Currency("RUB"), 2_c, 5_c), true));
+  ASSERT_TRUE(p.compose());
+  ASSERT_TRUE(p.save());
+
+  Wallet w1 = Wallet::get(addr1, s);
+  EXPECT_EQ(w1.balance(Currency("RUB")), 135_c);
+  EXPECT_EQ(w1.balance(Currency("USD")), 0_c);
+
+  Wallet w2 = Wallet::get(addr2, s);
+  EXPECT_EQ(w2.balance(Currency("RUB")), 5_c);
+
+  Wallet w3 = Wallet::get(addr3, s);
+  EXPECT_EQ(w3.balance(Currency("RUB")), 52_c);
+
+  // The account table is persistent and must give the same results after reopening
+  s.close();
+  ASSERT_TRUE(s.open(path_to_tests_));
+  EXPECT_EQ(Wallet::get(addr1, s).balance(Currency("RUB")), 135_c);
+  EXPECT_EQ(Wallet::get(addr1, s).amount(Currency("RUB")), 25_c);
+  EXPECT_EQ(Wallet::get(addr3, s).amount(Currency("RUB")), -28_c);
+}
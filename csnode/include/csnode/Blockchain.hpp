@@ -1,7 +1,7 @@
 #pragma once
 
-#include <map>
 #include <mutex>
+#include <vector>
 
 #include <csdb/address.h>
 #include <csdb/amount.h>
@@ -17,11 +17,13 @@ public:
 	void writeLastBlock(csdb::Pool&& pool);
 
 	csdb::PoolHash getLastHash();
+	csdb::PoolHash getHashBySequence(uint64_t sequence);
 	size_t getSize();
 
 	csdb::Pool loadBlock(const csdb::PoolHash&);
 	csdb::Pool loadBlockMeta(const csdb::PoolHash&, size_t& cnt);
 	csdb::Transaction loadTransaction(const csdb::TransactionID&);
+	std::vector<csdb::Transaction> getTransactions(const csdb::Address&, size_t offset, size_t limit);
 
 	csdb::Amount getBalance(const csdb::Address&);
 
@@ -32,8 +34,6 @@ public:
 private:
 	bool good_ = false;
 
-	std::map<csdb::Address, std::pair<csdb::PoolHash, csdb::Amount>> balancesCache_;
-
 	std::mutex dbLock_;
 	csdb::Storage storage_;
 };
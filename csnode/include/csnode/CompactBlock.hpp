@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <csdb/pool.h>
+#include <csdb/transaction.h>
+
+#include <net/SessionIO.hpp>
+
+namespace Credits {
+
+const size_t SHORT_TX_ID_LENGTH = 6;
+
+typedef FixedString<SHORT_TX_ID_LENGTH> ShortTxId;
+typedef FixedString<BLAKE2_HASH_LENGTH> BlockDigest;
+
+// A block as its header, the digest of its binary and short identifiers of its transactions.
+// The identifiers are keyed with the digest, so a collision in one block says nothing about
+// the next one. A receiver rebuilds the block from the transactions it already has, asks the
+// writer for the missing ones and checks the result against the digest.
+class CompactBlock {
+public:
+	static BlockDigest digest(const csdb::Pool&);
+	static ShortTxId shortId(const BlockDigest&, const csdb::Transaction&);
+
+	// The pool without its transactions, as a binary
+	static std::string header(const csdb::Pool&);
+
+	void init(const BlockDigest&, std::string&& header, std::vector<ShortTxId>&& ids);
+
+	// Takes the transactions the block refers to. One of two known transactions with the
+	// same identifier may be the wrong one, so neither is taken
+	void match(const std::vector<csdb::Transaction>& known);
+
+	// The indices of the transactions still missing
+	std::vector<uint32_t> missing() const;
+
+	// Takes the missing transactions in the order of missing(), false if they do not fit
+	bool fill(const csdb::Pool& reply);
+
+	// Forgets the matched transactions, when the block rebuilt from them was wrong
+	void reset();
+
+	bool complete() const;
+	const BlockDigest& getDigest() const { return digest_; }
+
+	// The pool, if it matches the digest; invalid otherwise
+	csdb::Pool build() const;
+
+private:
+	BlockDigest digest_;
+	std::string header_;
+	std::vector<ShortTxId> ids_;
+	std::vector<csdb::Transaction> transactions_;
+};
+
+} // namespace Credits
@@ -6,6 +6,7 @@
 #include <net/SessionIO.hpp>
 
 #include "Blockchain.hpp"
+#include "CompactBlock.hpp"
 
 #include <csstats.h>
 #include <csconnector/csconnector.h>
@@ -29,14 +30,17 @@ public:
 
 	/* Incoming requests processing */
 	void getInitRing(const char*, const size_t);
-	void getRoundTable(const char*, const size_t);
-	void getTransaction(const char*, const size_t);
-	void getFirstTransaction(const char*, const size_t);
-	void getTransactionsList(const char*, const size_t);
-	void getVector(const char*, const size_t, const NodeId&);
-	void getMatrix(const char*, const size_t, const NodeId&);
-	void getBlock(const char*, const size_t, const NodeId&);
-	void getHash(const char*, const size_t, const NodeId&);
+	void getRoundTable(const MessageData&);
+	void getTransaction(const MessageData&);
+	void getFirstTransaction(const MessageData&);
+	void getTransactionsList(const MessageData&);
+	void getVector(const MessageData&, const NodeId&);
+	void getMatrix(const MessageData&, const NodeId&);
+	void getBlock(const MessageData&, const NodeId&);
+	void getCompactBlock(const MessageData&, const NodeId&);
+	void getBlockRequest(const MessageData&, const NodeId&);
+	void getBlockReply(const MessageData&, const NodeId&);
+	void getHash(const MessageData&, const NodeId&);
 
 	/* Outcoming requests forming */
 	void sendRoundTable();
@@ -77,6 +81,11 @@ private:
 	inline void sendByConfidants(CommandList, SubCommandList, std::vector<TaskId>&);
 	inline void sendByConfidants(CommandList, SubCommandList);
 
+	void sendCompactBlock(const csdb::Pool&);
+	inline void rememberTransaction(const csdb::Transaction&);
+	inline void completeCompactBlock();
+	inline void requestBlockTransactions(const std::vector<uint32_t>&);
+
 	// Info
 	const NodeId myId_;
 	const PublicKey myPublicKey_;
@@ -92,6 +101,19 @@ private:
 	// Working mem
 	std::vector<TaskId> vectorTasks_;
 
+	// Compact blocks: the transactions seen in this round and the previous one, the block
+	// being rebuilt and the last block sent, for the requests of the missing transactions
+	std::vector<csdb::Transaction> knownTransactions_;
+	std::vector<csdb::Transaction> previousTransactions_;
+
+	CompactBlock compactBlock_;
+	NodeId compactSender_;
+	bool compactPending_ = false;
+	bool compactRetried_ = false;
+
+	csdb::Pool sentBlock_;
+	BlockDigest sentDigest_;
+
 	// Resources
 	BlockChain bc_;
     csstats::csstats stats;
@@ -9,40 +9,91 @@ public:
 	void init(const char* ptr, const size_t size) {
 		ptr_ = ptr;
 		end_ = ptr_ + size;
+		next_ = last_ = nullptr;
 		good_ = true;
 	}
 
+	// Reads the message right from its fragments
+	void init(const MessageData& message) {
+		ptr_ = end_ = nullptr;
+		next_ = message.parts;
+		last_ = message.parts + message.count;
+		lastSize_ = message.count ? message.size - (message.count - 1) * max_length : 0;
+		good_ = true;
+		nextPart();
+	}
+
 	template <typename T>
 	IPackStream& operator>>(T& cont) {
-		if ((ptr_ - end_) < sizeof(cont)) good_ = false;
-		else {
+		if (end_ - ptr_ >= (ptrdiff_t)sizeof(T)) {
 			cont = *(T*)ptr_;
 			ptr_ += sizeof(T);
 		}
+		else
+			readBytes((char*)&cont, sizeof(T));
 
 		return *this;
 	}
 
 	template <size_t Length>
 	IPackStream& operator>>(FixedString<Length>& str) {
-		if (end_ - ptr_ < Length) good_ = false;
-		else {
+		if (end_ - ptr_ >= (ptrdiff_t)Length) {
 			memcpy(str.str, ptr_, Length);
 			ptr_ += Length;
 		}
+		else
+			readBytes(str.str, Length);
 
 		return *this;
 	}
 
 	bool good() const { return good_; }
-	bool end() const { return ptr_ == end_; }
+	bool end() const { return ptr_ == end_ && next_ == last_; }
 
 	operator bool() const { return good() && !end(); }
 
 private:
+	// Moves to the next fragment once the current one is read
+	void nextPart() {
+		while (ptr_ == end_ && next_ != last_) {
+			ptr_ = (*next_)->data;
+			end_ = ptr_ + (next_ + 1 == last_ ? lastSize_ : max_length);
+			++next_;
+		}
+	}
+
+	size_t left() const {
+		return (end_ - ptr_) + (next_ == last_ ? 0 : (last_ - next_ - 1) * max_length + lastSize_);
+	}
+
+	void readBytes(char* dst, size_t size) {
+		if (left() < size) {
+			good_ = false;
+			return;
+		}
+
+		while (size > 0) {
+			nextPart();
+			const size_t toGet = std::min((size_t)(end_ - ptr_), size);
+			memcpy(dst, ptr_, toGet);
+			ptr_ += toGet;
+			dst += toGet;
+			size -= toGet;
+		}
+	}
+
+	// The unread data, for the decoders taking it as a whole
+	const std::vector<csdb::internal::byte_span>& restSpans();
+	void skipRest();
+
 	const char* ptr_;
 	const char* end_;
 	bool good_ = false;
+
+	const PacketPtr* next_ = nullptr;
+	const PacketPtr* last_ = nullptr;
+	size_t lastSize_ = 0;
+	std::vector<csdb::internal::byte_span> spans_;
 };
 
 class OPackStream {
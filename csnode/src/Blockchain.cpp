@@ -3,6 +3,8 @@
 
 #include "csnode/Blockchain.hpp"
 
+#include <csdb/wallet.h>
+
 #include "sys/timeb.h"
 
 namespace Credits {
@@ -34,6 +36,11 @@ csdb::PoolHash BlockChain::getLastHash() {
 	return storage_.last_hash();
 }
 
+csdb::PoolHash BlockChain::getHashBySequence(uint64_t sequence) {
+	std::lock_guard<std::mutex> l(dbLock_);
+	return storage_.hash_at(sequence);
+}
+
 size_t BlockChain::getSize() {
 	std::lock_guard<std::mutex> l(dbLock_);
 	return storage_.size();
@@ -55,52 +62,23 @@ csdb::Transaction BlockChain::loadTransaction(const csdb::TransactionID& transId
 	return storage_.transaction(transId);
 }
 
+std::vector<csdb::Transaction> BlockChain::getTransactions(const csdb::Address& address, size_t offset, size_t limit) {
+	std::lock_guard<std::mutex> l(dbLock_);
+	return storage_.transactions(address, limit, offset);
+}
+
 csdb::Address BlockChain::getAddressFromKey(const char* key) {
 	PublicKey hashedKey = getHashedPublicKey(key);
 	return csdb::Address::from_public_key(hashedKey.str);
 }
 
 csdb::Amount BlockChain::getBalance(const csdb::Address& address) {
-	csdb::PoolHash lastCheckedHash;
-	csdb::Amount cachedBalance(0);
-
-	csdb::PoolHash lastHash = getLastHash();
-
-	auto cacheIter = balancesCache_.find(address);
-	if (cacheIter != balancesCache_.end()) {
-		lastCheckedHash = cacheIter->second.first;
-		cachedBalance = cacheIter->second.second;
-
-		if (lastCheckedHash == lastHash) return cachedBalance;
-	}
+	std::lock_guard<std::mutex> l(dbLock_);
+	const csdb::Wallet wallet = storage_.wallet(address);
 
 	csdb::Amount result(0);
-	bool foundSource = false;
-	csdb::Pool curr = loadBlock(lastHash);
-
-	while (curr.is_valid() && curr.hash() != lastCheckedHash) {
-		csdb::Amount recordedBalance;
-
-		for (size_t i = 0; i < curr.transactions_count(); i++) {
-			csdb::Transaction tr = curr.transaction(i);
-			if (tr.source() == address) {
-				foundSource = true;
-				recordedBalance = tr.balance();
-			}
-			else if (tr.target() == address)
-				result += tr.amount();
-		}
-
-		if (foundSource) {
-			result += recordedBalance;
-			break;
-		}
-
-		curr = loadBlock(curr.previous_hash());
-	}
-
-	if (!foundSource) result += cachedBalance;
-	balancesCache_[address] = std::make_pair(lastHash, result);
+	for (const auto& currency : wallet.currencies())
+		result += wallet.balance(currency);
 
 	return result;
 }
@@ -0,0 +1,128 @@
+#include "csnode/CompactBlock.hpp"
+
+#include <cstring>
+#include <unordered_map>
+
+namespace Credits {
+
+namespace {
+
+uint64_t toKey(const ShortTxId& id) {
+	uint64_t result = 0;
+	memcpy(&result, id.str, SHORT_TX_ID_LENGTH);
+	return result;
+}
+
+} // namespace
+
+BlockDigest CompactBlock::digest(const csdb::Pool& pool) {
+	size_t size;
+	const char* data = const_cast<csdb::Pool&>(pool).to_byte_stream(size);
+
+	BlockDigest result;
+	blake2s(result.str, BLAKE2_HASH_LENGTH, data, size, nullptr, 0);
+	return result;
+}
+
+ShortTxId CompactBlock::shortId(const BlockDigest& digest, const csdb::Transaction& trans) {
+	const auto bytes = trans.to_byte_stream();
+
+	char hash[sizeof(uint64_t)];
+	blake2s(hash, sizeof(hash), bytes.data(), bytes.size(), digest.str, BLAKE2_HASH_LENGTH);
+	return ShortTxId(hash);
+}
+
+std::string CompactBlock::header(const csdb::Pool& pool) {
+	csdb::Pool result(pool.previous_hash(), pool.sequence());
+	for (auto id : pool.user_field_ids())
+		result.add_user_field(id, pool.user_field(id));
+
+	size_t size;
+	const char* data = result.to_byte_stream(size);
+	return std::string(data, size);
+}
+
+void CompactBlock::init(const BlockDigest& digest, std::string&& header, std::vector<ShortTxId>&& ids) {
+	digest_ = digest;
+	header_ = std::move(header);
+	ids_ = std::move(ids);
+
+	transactions_.clear();
+	transactions_.resize(ids_.size());
+}
+
+void CompactBlock::match(const std::vector<csdb::Transaction>& known) {
+	// Identifiers repeated in the block are left to the writer
+	std::unordered_map<uint64_t, size_t> indices;
+	indices.reserve(ids_.size());
+	for (size_t i = 0; i < ids_.size(); ++i) {
+		auto place = indices.emplace(toKey(ids_[i]), i);
+		if (!place.second)
+			place.first->second = ids_.size();
+	}
+
+	for (auto& trans : known) {
+		auto place = indices.find(toKey(shortId(digest_, trans)));
+		if (place == indices.end() || place->second == ids_.size()) continue;
+
+		csdb::Transaction& slot = transactions_[place->second];
+		if (!slot.is_valid())
+			slot = trans;
+		else if (slot.to_byte_stream() != trans.to_byte_stream()) {
+			slot = csdb::Transaction();
+			place->second = ids_.size();
+		}
+	}
+}
+
+std::vector<uint32_t> CompactBlock::missing() const {
+	std::vector<uint32_t> result;
+	for (size_t i = 0; i < transactions_.size(); ++i)
+		if (!transactions_[i].is_valid())
+			result.push_back((uint32_t)i);
+
+	return result;
+}
+
+bool CompactBlock::fill(const csdb::Pool& reply) {
+	const auto indices = missing();
+	if (reply.transactions_count() != indices.size())
+		return false;
+
+	for (size_t i = 0; i < indices.size(); ++i) {
+		const auto trans = reply.transaction(i);
+		if (!trans.is_valid()) return false;
+
+		transactions_[indices[i]] = trans;
+	}
+
+	return true;
+}
+
+void CompactBlock::reset() {
+	transactions_.assign(ids_.size(), csdb::Transaction());
+}
+
+bool CompactBlock::complete() const {
+	for (auto& trans : transactions_)
+		if (!trans.is_valid()) return false;
+
+	return true;
+}
+
+csdb::Pool CompactBlock::build() const {
+	csdb::Pool result = csdb::Pool::from_byte_stream(header_.data(), header_.size());
+	if (!result.is_valid() || result.transactions_count() != 0)
+		return csdb::Pool();
+
+	for (auto& trans : transactions_)
+		if (!result.add_transaction(trans))
+			return csdb::Pool();
+
+	if (!(digest(result) == digest_))
+		return csdb::Pool();
+
+	return result;
+}
+
+} // namespace Credits
@@ -12,6 +12,9 @@ const char PATH_TO_DB[] = "test_db";
 const unsigned MIN_CONFIDANTS = 3;
 const unsigned MAX_CONFIDANTS = 3;
 
+// Transactions kept per round to rebuild compact blocks from
+const size_t MAX_KNOWN_TRANSACTIONS = 100000;
+
 namespace Credits {
 
 Node::Node(const NodeId& myId, const PublicKey& pk, SessionIO* net)
@@ -23,7 +26,7 @@ Node::Node(const NodeId& myId, const PublicKey& pk, SessionIO* net)
   , solver_(
       Credits::SolverFactory().createSolver(Credits::solver_type::real, this))
   , stats(bc_)
-  , api(bc_, solver_.get())
+  , api(bc_, solver_.get(), net_)
 {
   good_ = init();
 }
@@ -47,9 +50,9 @@ Node::init()
 /* Requests */
 
 void
-Node::getRoundTable(const char* data, const size_t size)
+Node::getRoundTable(const MessageData& data)
 {
-  istream_.init(data, size);
+  istream_.init(data);
 
   if (!readRoundData(false))
     return;
@@ -81,17 +84,18 @@ Node::sendRoundTable()
 }
 
 void
-Node::getTransaction(const char* data, const size_t size)
+Node::getTransaction(const MessageData& data)
 {
   if (myLevel_ != NodeLevel::Main && myLevel_ != NodeLevel::Writer) {
     return;
   }
 
-  istream_.init(data, size);
+  istream_.init(data);
 
   while (istream_.good() && !istream_.end()) {
     csdb::Transaction trans;
     istream_ >> trans;
+    rememberTransaction(trans);
     solver_->gotTransaction(std::move(trans));
   }
 
@@ -111,6 +115,8 @@ Node::sendTransaction(const csdb::Transaction& trans)
   }
 #endif
 
+  rememberTransaction(trans);
+
   ostream_.init();
   ostream_ << trans;
 
@@ -119,7 +125,8 @@ Node::sendTransaction(const csdb::Transaction& trans)
                       CommandList::GetTransaction,
                       SubCommandList::Empty,
                       ostream_.lastSize(),
-                      mainNode_);
+                      mainNode_,
+                      TrafficClass::Transactions);
 }
 
 void
@@ -134,25 +141,28 @@ Node::sendTransaction(std::vector<csdb::Transaction>&& transactions)
 
   ostream_.init();
 
-  for (auto& tr : transactions)
+  for (auto& tr : transactions) {
+    rememberTransaction(tr);
     ostream_ << tr;
+  }
 
   LOG_EVENT("Sending transactions to " << mainNode_);
   net_->addTaskDirect(std::move(ostream_.get()),
                       CommandList::GetTransaction,
                       SubCommandList::Empty,
                       ostream_.lastSize(),
-                      mainNode_);
+                      mainNode_,
+                      TrafficClass::Transactions);
 }
 
 void
-Node::getFirstTransaction(const char* data, const size_t size)
+Node::getFirstTransaction(const MessageData& data)
 {
   if (myLevel_ != NodeLevel::Confidant) {
     return;
   }
 
-  istream_.init(data, size);
+  istream_.init(data);
 
   csdb::Transaction trans;
   istream_ >> trans;
@@ -163,7 +173,7 @@ Node::getFirstTransaction(const char* data, const size_t size)
   }
 
   LOG_EVENT("Got first transaction, initializing consensus...");
-
+  rememberTransaction(trans);
 
   solver_->gotTransactionList(std::move(trans));
 }
@@ -183,13 +193,13 @@ Node::sendFirstTransaction(const csdb::Transaction& trans)
 }
 
 void
-Node::getTransactionsList(const char* data, const size_t size)
+Node::getTransactionsList(const MessageData& data)
 {
   if (myLevel_ != NodeLevel::Confidant && myLevel_ != NodeLevel::Writer) {
     return;
   }
 
-  istream_.init(data, size);
+  istream_.init(data);
 
   csdb::Pool pool;
   istream_ >> pool;
@@ -200,6 +210,9 @@ Node::getTransactionsList(const char* data, const size_t size)
   }
 
   LOG_EVENT("Got full transactions list of " << pool.transactions_count());
+  for (size_t i = 0; i < pool.transactions_count(); ++i)
+    rememberTransaction(pool.transaction(i));
+
   solver_->gotBlockCandidate(std::move(pool));
 }
 
@@ -218,17 +231,18 @@ Node::sendTransactionList(const csdb::Pool& pool, const NodeId& target)
                       CommandList::GetBlockCandidate,
                       SubCommandList::Empty,
                       ostream_.lastSize(),
-                      target);
+                      target,
+                      TrafficClass::Transactions);
 }
 
 void
-Node::getVector(const char* data, const size_t size, const NodeId& sender)
+Node::getVector(const MessageData& data, const NodeId& sender)
 {
   if (myLevel_ != NodeLevel::Confidant) {
     return;
   }
 
-  istream_.init(data, size);
+  istream_.init(data);
 
   Vector vec;
   istream_ >> vec;
@@ -260,13 +274,13 @@ Node::sendVector(const Vector& vector)
 }
 
 void
-Node::getMatrix(const char* data, const size_t size, const NodeId& sender)
+Node::getMatrix(const MessageData& data, const NodeId& sender)
 {
   if (myLevel_ != NodeLevel::Confidant) {
     return;
   }
 
-  istream_.init(data, size);
+  istream_.init(data);
 
   Matrix mat;
   istream_ >> mat;
@@ -305,7 +319,7 @@ Node::sendMatrix(const Matrix& matrix)
 }
 
 void
-Node::getBlock(const char* data, const size_t size, const NodeId& sender)
+Node::getBlock(const MessageData& data, const NodeId& sender)
 {
   if (myLevel_ == NodeLevel::Writer) {
     return;
@@ -314,11 +328,13 @@ Node::getBlock(const char* data, const size_t size, const NodeId& sender)
   myLevel_ = NodeLevel::Normal;
 
 #ifdef NET_COMPRESSION
-  std::string decompressed;
-  ::snappy::Uncompress(data, size, &decompressed);
+  std::string compressed, decompressed;
+  istream_.init(data);
+  istream_ >> compressed;
+  ::snappy::Uncompress(compressed.data(), compressed.size(), &decompressed);
   istream_.init(decompressed.data(), decompressed.size());
 #else
-  istream_.init(data, size);
+  istream_.init(data);
 #endif
 
   csdb::Pool pool;
@@ -342,6 +358,11 @@ Node::sendBlock(const csdb::Pool& pool)
     return;
   }
 
+  if (net_->compactBlocks()) {
+    sendCompactBlock(pool);
+    return;
+  }
+
   ostream_.init();
   size_t bSize;
 #ifdef NET_COMPRESSION
@@ -354,18 +375,161 @@ Node::sendBlock(const csdb::Pool& pool)
 #endif
 
   LOG_EVENT("Sending block of " << pool.transactions_count());
-  net_->addTaskBroadcast(
-    std::move(ostream_.get()), SubCommandList::GetBlock, ostream_.lastSize());
+  net_->addTaskBroadcast(std::move(ostream_.get()),
+                         SubCommandList::GetBlock,
+                         ostream_.lastSize(),
+                         TrafficClass::Bulk);
 }
 
 void
-Node::getHash(const char* data, const size_t size, const NodeId& sender)
+Node::getCompactBlock(const MessageData& data, const NodeId& sender)
+{
+  if (myLevel_ == NodeLevel::Writer) {
+    return;
+  }
+
+  myLevel_ = NodeLevel::Normal;
+
+  istream_.init(data);
+
+  BlockDigest digest;
+  uint32_t count = 0;
+  istream_ >> digest >> count;
+
+  std::vector<ShortTxId> ids;
+  if (istream_.good() && count <= data.size / SHORT_TX_ID_LENGTH)
+    ids.resize(count);
+
+  for (auto& id : ids)
+    istream_ >> id;
+
+  std::string header;
+  istream_ >> header;
+
+  if (!istream_.good() || ids.size() != count || header.empty()) {
+    LOG_WARN("Bad compact block packet format");
+    return;
+  }
+
+  compactBlock_.init(digest, std::move(header), std::move(ids));
+  compactBlock_.match(previousTransactions_);
+  compactBlock_.match(knownTransactions_);
+
+  compactSender_ = sender;
+  compactPending_ = true;
+  compactRetried_ = false;
+
+  LOG_EVENT("Got compact block of " << count << ", missing "
+                                    << compactBlock_.missing().size());
+  completeCompactBlock();
+}
+
+void
+Node::sendCompactBlock(const csdb::Pool& pool)
+{
+  sentBlock_ = pool;
+  sentDigest_ = CompactBlock::digest(pool);
+
+  ostream_.init();
+  ostream_ << sentDigest_ << (uint32_t)pool.transactions_count();
+
+  for (size_t i = 0; i < pool.transactions_count(); ++i)
+    ostream_ << CompactBlock::shortId(sentDigest_, pool.transaction(i));
+
+  ostream_ << CompactBlock::header(pool);
+
+  LOG_EVENT("Sending compact block of " << pool.transactions_count());
+  net_->addTaskBroadcast(std::move(ostream_.get()),
+                         SubCommandList::GetCompactBlock,
+                         ostream_.lastSize(),
+                         TrafficClass::Bulk);
+}
+
+void
+Node::getBlockRequest(const MessageData& data, const NodeId& sender)
+{
+  istream_.init(data);
+
+  BlockDigest digest;
+  uint32_t count = 0;
+  istream_ >> digest >> count;
+
+  if (!istream_.good()) {
+    LOG_WARN("Bad block request packet format");
+    return;
+  }
+
+  if (!sentBlock_.is_valid() || !(digest == sentDigest_)) {
+    LOG_NOTICE("Block request for a block not sent last, ignoring");
+    return;
+  }
+
+  csdb::Pool reply(sentBlock_.previous_hash(), sentBlock_.sequence());
+
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t index = 0;
+    istream_ >> index;
+
+    if (!istream_.good() || index >= sentBlock_.transactions_count()) {
+      LOG_WARN("Bad block request packet format");
+      return;
+    }
+
+    reply.add_transaction(sentBlock_.transaction(index));
+  }
+
+  if (!istream_.end()) {
+    LOG_WARN("Bad block request packet format");
+    return;
+  }
+
+  ostream_.init();
+  ostream_ << digest << reply;
+
+  LOG_EVENT("Sending " << count << " block transactions to " << sender);
+  net_->addTaskDirect(std::move(ostream_.get()),
+                      CommandList::GetBlockReply,
+                      SubCommandList::Empty,
+                      ostream_.lastSize(),
+                      sender,
+                      TrafficClass::Bulk);
+}
+
+void
+Node::getBlockReply(const MessageData& data, const NodeId& sender)
+{
+  if (!compactPending_ || !(sender == compactSender_)) {
+    return;
+  }
+
+  istream_.init(data);
+
+  BlockDigest digest;
+  istream_ >> digest;
+
+  if (!istream_.good() || !(digest == compactBlock_.getDigest())) {
+    return;
+  }
+
+  csdb::Pool reply;
+  istream_ >> reply;
+
+  if (!istream_.good() || !istream_.end() || !compactBlock_.fill(reply)) {
+    LOG_WARN("Bad block reply packet format");
+    return;
+  }
+
+  completeCompactBlock();
+}
+
+void
+Node::getHash(const MessageData& data, const NodeId& sender)
 {
   if (myLevel_ != NodeLevel::Writer) {
     return;
   }
 
-  istream_.init(data, size);
+  istream_.init(data);
 
   Hash hash;
   istream_ >> hash;
@@ -432,6 +596,9 @@ Node::becomeWriter()
 void
 Node::onRoundStart()
 {
+  previousTransactions_.swap(knownTransactions_);
+  knownTransactions_.clear();
+
   if (mainNode_ == myId_)
     myLevel_ = NodeLevel::Main;
   else {
@@ -503,6 +670,63 @@ Node::sendByConfidants(CommandList cmd, SubCommandList scmd)
   }
 }
 
+inline void
+Node::rememberTransaction(const csdb::Transaction& trans)
+{
+  if (knownTransactions_.size() < MAX_KNOWN_TRANSACTIONS)
+    knownTransactions_.push_back(trans);
+}
+
+inline void
+Node::completeCompactBlock()
+{
+  const auto missing = compactBlock_.missing();
+  if (!missing.empty()) {
+    requestBlockTransactions(missing);
+    return;
+  }
+
+  csdb::Pool pool = compactBlock_.build();
+
+  if (!pool.is_valid()) {
+    // A short identifier took a wrong transaction: ask for all of them once
+    if (compactRetried_) {
+      LOG_WARN("Cannot rebuild compact block from " << compactSender_);
+      compactPending_ = false;
+      return;
+    }
+
+    compactRetried_ = true;
+    compactBlock_.reset();
+    requestBlockTransactions(compactBlock_.missing());
+    return;
+  }
+
+  compactPending_ = false;
+
+  LOG_EVENT("Got block of " << pool.transactions_count());
+  solver_->gotBlock(std::move(pool), compactSender_);
+}
+
+inline void
+Node::requestBlockTransactions(const std::vector<uint32_t>& indices)
+{
+  ostream_.init();
+  ostream_ << compactBlock_.getDigest() << (uint32_t)indices.size();
+
+  for (auto index : indices)
+    ostream_ << index;
+
+  LOG_EVENT("Requesting " << indices.size() << " block transactions from "
+                          << compactSender_);
+  net_->addTaskDirect(std::move(ostream_.get()),
+                      CommandList::GetBlockRequest,
+                      SubCommandList::Empty,
+                      ostream_.lastSize(),
+                      compactSender_,
+                      TrafficClass::Bulk);
+}
+
 inline bool
 Node::readRoundData(const bool tail)
 {
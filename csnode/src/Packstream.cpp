@@ -12,24 +12,46 @@ IPackStream& IPackStream::operator>>(Credits::NodeId& cont) {
     return *this;
 }
 
+const std::vector<csdb::internal::byte_span>& IPackStream::restSpans() {
+    spans_.clear();
+    if (ptr_ != end_)
+        spans_.push_back({ ptr_, (size_t)(end_ - ptr_) });
+
+    for (const PacketPtr* part = next_; part != last_; ++part)
+        spans_.push_back({ (*part)->data, part + 1 == last_ ? lastSize_ : (size_t)max_length });
+
+    return spans_;
+}
+
+void IPackStream::skipRest() {
+    ptr_ = end_;
+    next_ = last_;
+}
+
 template <>
 IPackStream& IPackStream::operator>>(std::string& str) {
-    str = std::string(ptr_, end_);
-    ptr_ = end_;
+    str.clear();
+    str.reserve(left());
+    for (auto& span : restSpans())
+        str.append((const char*)span.data, span.size);
+
+    skipRest();
     return *this;
 }
 
 template <>
 IPackStream& IPackStream::operator>>(csdb::Transaction& cont) {
-    cont = csdb::Transaction::from_byte_stream(ptr_, end_ - ptr_);
-    ptr_ = end_;
+    auto& spans = restSpans();
+    cont = csdb::Transaction::from_byte_stream(spans.data(), spans.size());
+    skipRest();
     return *this;
 }
 
 template <>
 IPackStream& IPackStream::operator>>(csdb::Pool& pool) {
-    pool = csdb::Pool::from_byte_stream(ptr_, end_ - ptr_);
-    ptr_ = end_;
+    auto& spans = restSpans();
+    pool = csdb::Pool::from_byte_stream(spans.data(), spans.size());
+    skipRest();
     return *this;
 }
 
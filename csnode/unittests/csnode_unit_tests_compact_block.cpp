@@ -0,0 +1,172 @@
+#include "csnode/CompactBlock.hpp"
+
+#include <csdb/address.h>
+#include <csdb/currency.h>
+
+#include <gtest/gtest.h>
+
+using namespace Credits;
+
+class CompactBlockTest : public ::testing::Test
+{
+protected:
+	void SetUp() override {
+		ASSERT_TRUE(source_.is_valid());
+		ASSERT_TRUE(target_.is_valid());
+
+		for (int32_t i = 1; i <= 10; ++i)
+			ASSERT_TRUE(pool_.add_transaction(transaction(i)));
+
+		digest_ = CompactBlock::digest(pool_);
+	}
+
+	// An address with a key of the size the node uses
+	static csdb::Address address(char last) {
+		return csdb::Address::from_string(std::string(publicKey_length * 2 - 1, '0') + last);
+	}
+
+	csdb::Transaction transaction(int32_t amount) const {
+		return csdb::Transaction(source_, target_, csdb::Currency("CS"), csdb::Amount(amount));
+	}
+
+	std::vector<ShortTxId> ids() const {
+		std::vector<ShortTxId> result;
+		for (size_t i = 0; i < pool_.transactions_count(); ++i)
+			result.push_back(CompactBlock::shortId(digest_, pool_.transaction(i)));
+
+		return result;
+	}
+
+	// A block as a receiver gets it
+	CompactBlock received(std::vector<ShortTxId>&& ids) const {
+		CompactBlock result;
+		result.init(digest_, CompactBlock::header(pool_), std::move(ids));
+		return result;
+	}
+
+	std::vector<csdb::Transaction> transactions(std::initializer_list<size_t> indices) const {
+		std::vector<csdb::Transaction> result;
+		for (auto i : indices)
+			result.push_back(pool_.transaction(i));
+
+		return result;
+	}
+
+	csdb::Pool reply(const std::vector<uint32_t>& indices) const {
+		csdb::Pool result(pool_.previous_hash(), pool_.sequence());
+		for (auto i : indices)
+			EXPECT_TRUE(result.add_transaction(pool_.transaction(i)));
+
+		return result;
+	}
+
+	void expectBuilt(const CompactBlock& block) {
+		EXPECT_TRUE(block.complete());
+
+		csdb::Pool built = block.build();
+		ASSERT_TRUE(built.is_valid());
+		EXPECT_EQ(built.transactions_count(), pool_.transactions_count());
+		EXPECT_TRUE(CompactBlock::digest(built) == digest_);
+	}
+
+	const csdb::Address source_ = address('1');
+	const csdb::Address target_ = address('2');
+
+	csdb::Pool pool_{csdb::PoolHash{}, 7};
+	BlockDigest digest_;
+};
+
+TEST_F(CompactBlockTest, BuildFromKnown)
+{
+	CompactBlock block = received(ids());
+	EXPECT_EQ(block.missing().size(), 10u);
+	EXPECT_FALSE(block.complete());
+
+	// The order of the known transactions does not matter
+	block.match(transactions({9, 8, 7, 6, 5, 4, 3, 2, 1, 0}));
+	EXPECT_TRUE(block.missing().empty());
+	expectBuilt(block);
+}
+
+TEST_F(CompactBlockTest, MatchTakesOnlyBlockTransactions)
+{
+	CompactBlock block = received(ids());
+	block.match({ transaction(100), transaction(200) });
+	EXPECT_EQ(block.missing().size(), 10u);
+
+	block.match(transactions({0, 3}));
+	block.match(transactions({3, 9}));
+	EXPECT_EQ(block.missing(), (std::vector<uint32_t>{1, 2, 4, 5, 6, 7, 8}));
+}
+
+TEST_F(CompactBlockTest, FillMissing)
+{
+	CompactBlock block = received(ids());
+	block.match(transactions({0, 2, 4, 6, 8}));
+
+	const auto missing = block.missing();
+	ASSERT_EQ(missing, (std::vector<uint32_t>{1, 3, 5, 7, 9}));
+
+	EXPECT_TRUE(block.fill(reply(missing)));
+	EXPECT_TRUE(block.missing().empty());
+	expectBuilt(block);
+}
+
+TEST_F(CompactBlockTest, FillBadReplyCount)
+{
+	CompactBlock block = received(ids());
+	block.match(transactions({0, 2, 4, 6, 8}));
+
+	EXPECT_FALSE(block.fill(reply({1, 3, 5, 7})));
+	EXPECT_FALSE(block.fill(reply({1, 3, 5, 7, 9, 0})));
+	EXPECT_FALSE(block.fill(csdb::Pool{}));
+	EXPECT_EQ(block.missing(), (std::vector<uint32_t>{1, 3, 5, 7, 9}));
+
+	EXPECT_TRUE(block.fill(reply({1, 3, 5, 7, 9})));
+	expectBuilt(block);
+}
+
+TEST_F(CompactBlockTest, AmbiguousIdsAreLeftMissing)
+{
+	// Two transactions of the block with the same identifier can't be told apart
+	auto same = ids();
+	same[4] = same[2];
+
+	CompactBlock block = received(std::move(same));
+	block.match(transactions({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+	EXPECT_EQ(block.missing(), (std::vector<uint32_t>{2, 4}));
+
+	EXPECT_TRUE(block.fill(reply({2, 4})));
+	expectBuilt(block);
+}
+
+TEST_F(CompactBlockTest, WrongMatchRetry)
+{
+	// The identifier of the first transaction also fits another known one
+	const csdb::Transaction other = transaction(100);
+	auto wrong = ids();
+	wrong[0] = CompactBlock::shortId(digest_, other);
+
+	CompactBlock block = received(std::move(wrong));
+	block.match(transactions({1, 2, 3, 4, 5, 6, 7, 8, 9}));
+	block.match({ other });
+	EXPECT_TRUE(block.complete());
+	EXPECT_FALSE(block.build().is_valid());
+
+	// The receiver then asks for the whole block once
+	block.reset();
+	const auto missing = block.missing();
+	EXPECT_EQ(missing.size(), 10u);
+
+	EXPECT_TRUE(block.fill(reply(missing)));
+	expectBuilt(block);
+}
+
+TEST_F(CompactBlockTest, BadHeader)
+{
+	CompactBlock block;
+	block.init(digest_, std::string("\1\2\3"), ids());
+	block.match(transactions({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+	EXPECT_TRUE(block.complete());
+	EXPECT_FALSE(block.build().is_valid());
+}
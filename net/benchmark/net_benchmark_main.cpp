@@ -0,0 +1,96 @@
+#include "net/Structures.hpp"
+
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+const size_t FILTER_CAPACITY = 50000;
+
+struct Fragment {
+	char hashBlock[hash_length];
+	uint16_t index;
+};
+
+// Received fragments: every one comes from three senders, the redirected copies
+// arriving a little later than the first one
+std::vector<Fragment> makeTraffic() {
+	const size_t messages = FILTER_CAPACITY * 4;
+	const size_t fragments = 4;
+	const size_t delays[] = { 0, 64, 1024 };
+
+	std::mt19937_64 random(1);
+	std::vector<Fragment> unique(messages * fragments);
+	for (size_t i = 0; i < messages; ++i) {
+		// Only the last 32 bytes of a HashBlock are random, as with MessageHasher
+		char block[hash_length] = {};
+		for (size_t j = hash_length - 32; j < hash_length; j += sizeof(uint64_t)) {
+			const uint64_t word = random();
+			memcpy(block + j, &word, sizeof(word));
+		}
+
+		for (size_t j = 0; j < fragments; ++j) {
+			auto& fragment = unique[i * fragments + j];
+			memcpy(fragment.hashBlock, block, hash_length);
+			fragment.index = (uint16_t)j;
+		}
+	}
+
+	std::vector<Fragment> traffic;
+	for (size_t i = 0; i < unique.size(); ++i)
+		for (auto delay : delays)
+			if (i >= delay)
+				traffic.push_back(unique[i - delay]);
+
+	return traffic;
+}
+
+const std::vector<Fragment>& traffic() {
+	static const auto result = makeTraffic();
+	return result;
+}
+
+} // namespace
+
+// The key of the former SessionIO::getBackDataCounter
+static void circularMap(benchmark::State &state)
+{
+	const auto& fragments = traffic();
+	CircularMap<Hash, uint32_t, FILTER_CAPACITY> map;
+
+	size_t next = 0, duplicates = 0;
+	for (auto _ : state)
+	{
+		const auto& fragment = fragments[next];
+		next = (next + 1) % fragments.size();
+
+		Hash key{ fragment.hashBlock };
+		*((uint16_t*)(key.str)) = fragment.index;
+		duplicates += map.pushAndIncrease(key) > 1;
+	}
+
+	state.counters["duplicates"] = double(duplicates) / state.iterations();
+}
+BENCHMARK(circularMap);
+
+static void dedupFilter(benchmark::State &state)
+{
+	const auto& fragments = traffic();
+	DedupFilter<FILTER_CAPACITY> filter(std::chrono::milliseconds(state.range(0)));
+
+	size_t next = 0, duplicates = 0;
+	for (auto _ : state)
+	{
+		const auto& fragment = fragments[next];
+		next = (next + 1) % fragments.size();
+
+		duplicates += filter.pushAndIncrease(DedupFilter<FILTER_CAPACITY>::fingerprint(fragment.hashBlock, fragment.index)) > 1;
+	}
+
+	state.counters["duplicates"] = double(duplicates) / state.iterations();
+}
+BENCHMARK(dedupFilter)->Arg(0)->Arg(60000);
+
+BENCHMARK_MAIN();
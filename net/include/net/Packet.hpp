@@ -1,8 +1,15 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <cstddef>
+#include <cstdlib>
 #include <cstring>
+#include <vector>
 
 #include "Hash.hpp"
 
@@ -33,7 +40,12 @@ enum CommandList {
 	RegistrationConnectionRefused = 25,
 	SendBlockCandidate = 28,
 	GetBlockCandidate = 29,
-	GetFirstTransaction = 30
+	GetFirstTransaction = 30,
+	Ack = 31,                 // A direct message is complete, HashBlock names it
+	Nack = 32,                // Data: uint16_t count followed by the missing fragment indices
+	Bundle = 33,              // Data: small direct messages, each a BundleEntry followed by its data
+	GetBlockRequest = 34,     // Data: block digest, count and indices of the transactions missing from a compact block
+	GetBlockReply = 35        // Data: block digest followed by a pool of those transactions
 };
 
 
@@ -49,7 +61,8 @@ enum SubCommandList {
 	SGetVector,
 	SGetMatrix,
 	SGetHash,
-	SGetIpTable
+	SGetIpTable,
+	GetCompactBlock          // Data: block digest, count and short identifiers of the transactions, block header
 };
 
 enum Version {
@@ -73,13 +86,216 @@ struct Packet {
 
 	constexpr static unsigned int headerLength() { return sizeof(Packet) - max_length; }
 };
+
+// A message inside a Bundle: the rest of its header is the one of the bundle
+struct BundleEntry {
+	char	 command;
+	char	 subcommand;
+	char	 HashBlock[hash_length];
+	uint16_t size;
+};
 #pragma pack(pop)
 
+// Forward error correction of multi-fragment messages. The data fragments but the last
+// one are split into groups of FEC_GROUP_SIZE, each followed by a parity fragment holding
+// their XOR; the last, usually shorter, fragment is protected by a copy. Parity fragments
+// take the indices from countHeader on, which older receivers drop as out of range.
+const size_t FEC_GROUP_SIZE = 8;
+
+inline size_t fecParityCount(const size_t count) {
+	return count > 1 ? (count - 2) / FEC_GROUP_SIZE + 2 : 0;
+}
+
+inline void xorFragment(char* dst, const char* src, const size_t size) {
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+		uint64_t a, b;
+		memcpy(&a, dst + i, sizeof(a));
+		memcpy(&b, src + i, sizeof(b));
+		a ^= b;
+		memcpy(dst + i, &a, sizeof(a));
+	}
+
+	for (; i < size; ++i)
+		dst[i] ^= src[i];
+}
+
+// Packets come in size classes holding up to PACKET_CAPACITIES[sizeClass] bytes of data:
+// most consensus messages fit the small one, fragments of long messages take the full one
+const size_t PACKET_SIZE_CLASSES = 3;
+const size_t PACKET_CAPACITIES[PACKET_SIZE_CLASSES] = { 512, 8192, max_length };
+
+inline size_t packetSizeClass(const size_t dataSize) {
+	size_t result = 0;
+	while (result + 1 < PACKET_SIZE_CLASSES && PACKET_CAPACITIES[result] < dataSize)
+		++result;
+	return result;
+}
+
+class PacketPool;
+
+// Packets are shared between the threads, so the counter is atomic; a packet knows the pool
+// it returns to. The memory of a packet ends right after its capacity, so p.data may be
+// shorter than declared
 struct PacketWithCounter {
-	uint32_t counter;
+	std::atomic<uint32_t> counter;
+	std::atomic<uint32_t> next;	// The free list link: index + 1 of the next packet, 0 ends it
+	uint32_t index;
+	uint32_t sizeClass;
+	PacketPool* pool;
 	Packet p;
 };
 
+// Free packets of one size class. The shared list is a lock-free (Treiber) stack, and every
+// thread keeps a few packets in front of it, so most allocations and releases touch no
+// shared memory. Packets are addressed by 32-bit indices, which leaves room in the head
+// for a tag changing on every update against the ABA problem. Only growing takes a lock.
+// The threads releasing packets have to exit before the pool is destroyed, or be the one
+// destroying it
+class PacketPool {
+public:
+	PacketPool(const size_t sizeClass, const size_t pageSize) :
+		sizeClass_(sizeClass),
+		pageSize_(pageSize),
+		slotSize_(slotSize(sizeClass)) { }
+
+	PacketPool(const PacketPool&) = delete;
+	PacketPool& operator=(const PacketPool&) = delete;
+
+	~PacketPool() {
+		LocalCache& cache = localCache(sizeClass_);
+		if (cache.pool == this) {
+			cache.pool = nullptr;
+			cache.count = 0;
+		}
+
+		for (size_t i = 0; i < pagesCount_; ++i)
+			free(pages_[i].load(std::memory_order_relaxed));
+	}
+
+	PacketWithCounter* get() {
+		LocalCache& cache = localCache(sizeClass_);
+		if (cache.pool == this && cache.count)
+			return cache.packs[--cache.count];
+
+		uint64_t head = head_.load(std::memory_order_acquire);
+		for (;;) {
+			const uint32_t top = (uint32_t)head;
+			if (!top) {
+				grow();
+				head = head_.load(std::memory_order_acquire);
+				continue;
+			}
+
+			// A stale link fails the exchange, as the tag has changed since
+			PacketWithCounter* pack = at(top - 1);
+			const uint64_t next = nextTag(head) | pack->next.load(std::memory_order_relaxed);
+			if (head_.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire))
+				return pack;
+		}
+	}
+
+	void release(PacketWithCounter* pack) {
+		LocalCache& cache = localCache(sizeClass_);
+		if (cache.pool != this) {
+			cache.flush();
+			cache.pool = this;
+		}
+
+		// A thread releasing more than it takes hands the surplus over
+		if (cache.count == LOCAL_CACHE_SIZE) {
+			push(cache.packs + LOCAL_CACHE_SIZE / 2, LOCAL_CACHE_SIZE / 2);
+			cache.count = LOCAL_CACHE_SIZE / 2;
+		}
+
+		cache.packs[cache.count++] = pack;
+	}
+
+private:
+	static const size_t LOCAL_CACHE_SIZE = 64;
+	static const size_t MAX_PAGES = 4096;
+
+	struct LocalCache {
+		~LocalCache() {
+			flush();
+		}
+
+		void flush() {
+			if (pool && count)
+				pool->push(packs, count);
+			pool = nullptr;
+			count = 0;
+		}
+
+		PacketPool* pool = nullptr;
+		size_t count = 0;
+		PacketWithCounter* packs[LOCAL_CACHE_SIZE];
+	};
+
+	static LocalCache& localCache(const size_t sizeClass) {
+		thread_local LocalCache caches[PACKET_SIZE_CLASSES];
+		return caches[sizeClass];
+	}
+
+	static size_t slotSize(const size_t sizeClass) {
+		const size_t size = offsetof(PacketWithCounter, p) + Packet::headerLength() + PACKET_CAPACITIES[sizeClass];
+		return (size + alignof(PacketWithCounter) - 1) / alignof(PacketWithCounter) * alignof(PacketWithCounter);
+	}
+
+	static uint64_t nextTag(const uint64_t head) {
+		return ((head >> 32) + 1) << 32;
+	}
+
+	PacketWithCounter* at(const uint32_t index) const {
+		return (PacketWithCounter*)(pages_[index / pageSize_].load(std::memory_order_acquire) + (index % pageSize_) * slotSize_);
+	}
+
+	// Links the packets in a chain and puts it on top of the shared list
+	void push(PacketWithCounter* const* packs, const size_t count) {
+		for (size_t i = 0; i + 1 < count; ++i)
+			packs[i]->next.store(packs[i + 1]->index + 1, std::memory_order_relaxed);
+
+		PacketWithCounter* last = packs[count - 1];
+		const uint64_t first = packs[0]->index + 1;
+
+		uint64_t head = head_.load(std::memory_order_relaxed);
+		do {
+			last->next.store((uint32_t)head, std::memory_order_relaxed);
+		} while (!head_.compare_exchange_weak(head, nextTag(head) | first, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	void grow() {
+		std::lock_guard<std::mutex> lock(growLock_);
+		if ((uint32_t)head_.load(std::memory_order_acquire)) return;	// Another thread did
+		if (pagesCount_ == MAX_PAGES) throw std::bad_alloc();
+
+		char* page = (char*)malloc(slotSize_ * pageSize_);
+		if (!page) throw std::bad_alloc();
+
+		std::vector<PacketWithCounter*> packs(pageSize_);
+		for (size_t i = 0; i < pageSize_; ++i) {
+			PacketWithCounter* pack = (PacketWithCounter*)(page + i * slotSize_);
+			pack->index = (uint32_t)(pagesCount_ * pageSize_ + i);
+			pack->sizeClass = (uint32_t)sizeClass_;
+			pack->pool = this;
+			packs[i] = pack;
+		}
+
+		pages_[pagesCount_++].store(page, std::memory_order_release);
+		push(packs.data(), packs.size());
+	}
+
+	const size_t sizeClass_;
+	const size_t pageSize_;
+	const size_t slotSize_;
+
+	std::atomic<uint64_t> head_{ 0 };	// Tag in the high half, index + 1 of the top packet in the low one
+
+	std::mutex growLock_;
+	std::atomic<char*> pages_[MAX_PAGES] = {};
+	size_t pagesCount_ = 0;
+};
+
 class PacketPtr {
 public:
 	PacketPtr() { }
@@ -129,64 +345,60 @@ public:
 
 private:
 	PacketPtr(PacketWithCounter* ptr) : ptr_(ptr) {
-		ptr_->counter = 1;
+		ptr_->counter.store(1, std::memory_order_relaxed);
 	}
 
 	void increment() {
 		if (ptr_)
-			++(ptr_->counter);
+			ptr_->counter.fetch_add(1, std::memory_order_relaxed);
 	}
 
+	// The last owner sees all the writes of the others before the packet is reused
 	void decrement() {
-		if (ptr_ && !(--(ptr_->counter)))
-			freeFunc(this);
+		if (ptr_ && ptr_->counter.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			ptr_->pool->release(ptr_);
 	}
 
 	PacketWithCounter* ptr_ = nullptr;
-	static std::function<void(PacketPtr*)> freeFunc;
 
 	template <size_t> friend class PacketManager;
 };
 
+// A received message as it lies in its fragments: all of them but the last one hold
+// max_length bytes of data. A single packet is a message of one fragment
+struct MessageData {
+	const PacketPtr* parts;
+	std::size_t count;
+	std::size_t size;
+};
 
+// A pool per size class; pages of PageSize packets are allocated on demand
 template <size_t PageSize>
 class PacketManager {
 public:
-	PacketManager() { 
-		allocateNewPage();
-		PacketPtr::freeFunc = [this](PacketPtr* p) { freeMem(p); };
-	}
+	static_assert(PACKET_SIZE_CLASSES == 3, "A pool per size class");
 
-	~PacketManager() {
-		for (PacketWithCounter* p : pages_) free(p);
-	}
+	PacketManager() :
+		pools_{ { 0, PageSize }, { 1, PageSize }, { 2, PageSize } } { }
 
-	PacketPtr getFreePack() {
-		if (freeStack_.empty())
-			allocateNewPage();
+	// A packet with room for at least dataSize bytes of data
+	PacketPtr getFreePack(const size_t dataSize = max_length) {
+		return PacketPtr(pools_[packetSizeClass(dataSize)].get());
+	}
 
-		PacketPtr result(freeStack_.back());
-		freeStack_.pop_back();
+	// The packet moved to the smallest class holding its first packSize bytes
+	PacketPtr shrink(const PacketPtr& pack, const size_t packSize) {
+		const size_t dataSize = packSize > Packet::headerLength() ? packSize - Packet::headerLength() : 0;
+		if (packetSizeClass(dataSize) >= pack.ptr_->sizeClass)
+			return pack;
 
+		PacketPtr result = getFreePack(dataSize);
+		memcpy(result.get(), pack.get(), packSize);
 		return result;
 	}
 
-	void freeMem(PacketPtr* pack) {
-		freeStack_.push_back(pack->ptr_);
-	}
-
 private:
-	void allocateNewPage() {
-		pages_.push_back((PacketWithCounter*)malloc(sizeof(PacketWithCounter) * PageSize));
-		freeStack_.reserve(pages_.size() * PageSize);
-
-		PacketWithCounter* ptr = pages_.back();
-		for (size_t i = 0; i < PageSize; ++i, ++ptr)
-			freeStack_.push_back(ptr);
-	}
-
-	std::vector<PacketWithCounter*> pages_;
-	std::vector<PacketWithCounter*> freeStack_;
+	PacketPool pools_[PACKET_SIZE_CLASSES];
 };
 
 template <std::size_t HashSize>
@@ -8,6 +8,8 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <deque>
+#include <memory>
+#include <thread>
 
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
@@ -47,24 +49,52 @@ public:
 	// Talking to Node
 	void addToRingBuffer(const boost::asio::ip::address&);
 
+	// Node timers share the task scheduler with the retransmissions
 	template <typename CallBack, typename... Args>
 	void waitOnTimer(const std::chrono::milliseconds& timeout, CallBack cb, Args... args) {
-		auto t = new boost::asio::steady_timer(io_service_client_, timeout);
-		t->async_wait([t, cb, args...](const boost::system::error_code& ec) {
-			cb(args...);
-			delete t;
-		});
+		m_taskman.addTimer(Clock::now() + timeout, [cb, args...]() { cb(args...); });
+		io_service_client_.dispatch([this] { scheduleTasks(); });
 	}
 
 	PacketPtr getEmptyPacket() { return m_pacman.getFreePack(); }
 
-	TaskId addTaskDirect(std::vector<PacketPtr>&& packets, const CommandList cmd, const SubCommandList smd, const size_t lastSize, const ip::address& ip);
-	TaskId addTaskBroadcast(std::vector<PacketPtr>&&, const SubCommandList, const size_t lastSize);
+	// The traffic class decides how the messages share the link with the others, see SendScheduler
+	TaskId addTaskDirect(std::vector<PacketPtr>&& packets, const CommandList cmd, const SubCommandList smd, const size_t lastSize, const ip::address& ip, const TrafficClass cls = TrafficClass::Consensus);
+	TaskId addTaskBroadcast(std::vector<PacketPtr>&&, const SubCommandList, const size_t lastSize, const TrafficClass cls = TrafficClass::Consensus);
 
 	void removeTask(TaskId tId) { m_taskman.remove(tId); }
-	void removeAllTasks() { m_taskman.clear(); }
+	void removeAllTasks();
+
+	// Blocks go out as compact blocks instead of full ones ([network] compactBlocks)
+	bool compactBlocks() const { return compactBlocks_; }
+
+	// Round-trip estimates of the peers that acknowledged a direct message, for the metrics;
+	// the network one takes the samples of all of them and times the broadcasts
+	std::vector<std::pair<ip::address_v4, RttEstimator>> getPeerRtt();
+	RttEstimator getNetworkRtt();
 
 private:
+	// Receive side state. The main socket has one; with [network] receiveThreads > 1 every
+	// SO_REUSEPORT socket gets its own, with an io_service running on a separate thread.
+	// Each message belongs to the shard its HashBlock picks, which deduplicates, redirects and
+	// reassembles it and hands it over to the main loop, the only one talking to the Node.
+	struct ReceiveShard {
+		~ReceiveShard();
+
+		void stop();
+
+		udp::socket* socket = nullptr;
+		udp::endpoint sender;
+		ip::address lastSender;
+		bool deferred = false;
+
+		DedupFilter<50000> backData;	// Copies of the recent fragments
+		PacketCollector<Hash, 1000, MAX_PART> packets;
+
+		boost::asio::io_service io;
+		std::thread thread;
+	};
+
 	ip::address MyIp_;
 	Hash MyHash_;            //Hash of the node
 	PublicKey MyPublicKey_;  //Public key of the node
@@ -93,31 +123,94 @@ private:
 	udp::resolver OutputServiceResolver_;		 // Server Solver
 
 	NodesRing<500> m_nodesRing;						// Ring storage buffer nodes
-	CircularMap<Hash, uint32_t, 50000> m_backData;	// Ring buffer storage of previous information
-	PacketCollector<Hash, 1000, MAX_PART> m_packets;
-	PacketManager<2048> m_pacman;
+	PacketManager<128> m_pacman;
 	MessageHasher<BLAKE2_HASH_LENGTH> m_hasher;
 
 	TaskManager m_taskman;
-	std::thread m_senderThread;
 
-	char* m_combinedData;
+	// Armed at the earliest task launch time, so the loop sleeps while there is nothing to do
+	boost::asio::steady_timer m_taskTimer{ io_service_client_ };
+	Clock::time_point m_taskDeadline;
+	bool m_taskTimerArmed = false;
+	bool measureWakeups_ = false;
+
+	// Protocol extensions, all off by default: see [network] selectiveAck, fec and compactBlocks
+	bool selectiveAck_ = false;
+	bool fec_ = false;
+	bool compactBlocks_ = false;
+
+	// Peers of the redirects: the whole ring by default, a random subset in the gossip mode
+	GossipSelector m_gossip;
+
+	// Direct tasks by the receiver address, to find the one a Ack/Nack refers to
+	std::mutex m_directLock;
+	std::unordered_multimap<ip::address_v4::uint_type, TaskId> m_directTasks;
+
+	// Retransmission timeouts of the tasks, fed by the acknowledgements
+	std::unordered_map<ip::address_v4::uint_type, RttEstimator> m_peerRtt;
+	RttEstimator m_networkRtt;
+
+	// Batched I/O: the input socket is drained with recvmmsg and the queued sends go out
+	// with sendmmsg (Linux only, see [network] batchedIO)
+	struct QueuedSend {
+		PacketPtr packet;
+		std::size_t size;
+		udp::endpoint endpoint;
+	};
+
+	bool batchedIO_ = false;
+
+	// The sends wait in the queues of their traffic classes and leave a batch per loop pass,
+	// so the other handlers may queue urgent messages in between. A batch goes once the
+	// socket takes more, or once a paced class may send again
+	boost::detail::spinlock m_sendLock = BOOST_DETAIL_SPINLOCK_INIT;
+	SendScheduler<QueuedSend> m_sendQueues;
+	bool m_flushPosted = false;
+	std::vector<QueuedSend> m_sendBatch;
+	boost::asio::steady_timer m_flushTimer{ io_service_client_ };
+	bool m_writeWaiting = false;
+
+	// Small direct messages to the same peer share a datagram ([network] coalesce)
+	bool coalesce_ = false;
+	std::chrono::microseconds coalesceWindow_{ 200 };
+	MessageCoalescer m_coalescer;
+	boost::asio::steady_timer m_coalesceTimer{ io_service_client_ };
+
+	ReceiveShard m_mainShard;
+	std::vector<std::unique_ptr<ReceiveShard>> m_shards;
+	unsigned receiveThreads_ = 1;
+	std::chrono::milliseconds dedupWindow_{ 0 };
 
 	bool Initialization();
 
 	
     //Method of receiving information
-	inline void InputServiceHandleReceive(PacketPtr message, const boost::system::error_code & error, std::size_t bytes_transferred);
+	inline void InputServiceHandleReceive(ReceiveShard&, PacketPtr message, const boost::system::error_code & error, std::size_t bytes_transferred);
+	void handleMessage(ReceiveShard&, PacketPtr message, std::size_t size);
+	void deliverMessage(const Packet& header, const MessageData& data);
 	void outputHandleSend(PacketPtr message, const boost::system::error_code& error, std::size_t bytes_transferred);
 
 	//Sending info
-	inline void createSendTasks(const std::vector<PacketPtr>&, const CommandList, const SubCommandList, const size_t lastSize);
+	inline void createSendTasks(std::vector<PacketPtr>&, const CommandList, const SubCommandList, const size_t lastSize);
+	void addParity(std::vector<PacketPtr>&, const size_t lastSize);
 
 	inline void outFrmPack(const PacketPtr, const CommandList, const SubCommandList, const Version, const size_t size_data);
 	inline void outSendPack(PacketPtr, std::size_t, const udp::endpoint*);
-	inline void handleSend(PacketPtr, std::size_t, const udp::endpoint&);
-
-	void senderThreadRoutine();
+	inline void handleSend(PacketPtr, std::size_t, const udp::endpoint&, const TrafficClass);
+	void queueSend(PacketPtr, std::size_t, const udp::endpoint&, const TrafficClass);
+	bool coalesced(const PacketPtr&, std::size_t, const udp::endpoint&) const;
+	void flushCoalesced();
+
+	// Selective acknowledgement of the direct messages
+	void sendAck(ReceiveShard&, const Packet&, const PacketPart*);
+	void handleAck(const Packet&, std::size_t);
+	void sendPacketAsync(PacketPtr, std::size_t, const udp::endpoint&);
+	void flushSends();
+	void postFlush();
+
+	// Sends the tasks due, run by m_taskTimer
+	void launchTasks();
+	void scheduleTasks();
 
 	//The method of starting all processes
 	inline bool GenerationHash();
@@ -125,10 +218,15 @@ private:
 
 	void ReceiveRegistration();
 	void StartReceive();
+	void StartReceive(ReceiveShard&);
+	void receiveBatch(ReceiveShard&);
+	bool startShards();
+	void noteSender(ReceiveShard&);
 
 	//Method of sending information to nodes
-	inline bool RunRedirect(PacketPtr, std::size_t);
-	inline uint32_t getBackDataCounter(PacketPtr);
+	inline bool RunRedirect(ReceiveShard&, PacketPtr, std::size_t);
+	void redirectPack(PacketPtr, std::size_t);
+	inline uint32_t getBackDataCounter(ReceiveShard&, PacketPtr);
 
 	inline void RegistrationToServer();
 
@@ -1,13 +1,18 @@
 #pragma once
 
 #include <algorithm>
+#include <deque>
+#include <functional>
 #include <list>
+#include <mutex>
+#include <random>
 #include <memory>
 #include <set>
 #include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
 #include <chrono>
+#include <cstdlib>
 
 #include <boost/asio.hpp>
 
@@ -50,34 +55,224 @@ private:
 	std::deque<Key> queue_;
 };
 
-struct PacketPart {
-	PacketPart(PacketPtr* mem, size_t maxSize) : packets(mem), size(maxSize), left(maxSize) {
-		memset(packets, 0, sizeof(PacketPtr) * maxSize);
+// Fixed-memory duplicate filter: counts the copies of a key by its 64-bit fingerprint.
+// Slots are grouped into cache-line buckets of four and a key may live in either of two
+// buckets; a new key takes an empty or expired slot of them, or evicts the oldest one. With a window set, keys older than it
+// are forgotten; without one they live until evicted
+template <size_t Capacity>
+class DedupFilter {
+public:
+	explicit DedupFilter(std::chrono::milliseconds window = std::chrono::milliseconds(0)) :
+		mem_(new char[sizeof(Bucket) * (BUCKETS_COUNT + 1)]),
+		buckets_(reinterpret_cast<Bucket*>((reinterpret_cast<uintptr_t>(mem_.get()) + sizeof(Bucket) - 1) & ~(uintptr_t(sizeof(Bucket)) - 1))),
+		epoch_(Clock::now()) {
+		setWindow(window);
+		clear();
 	}
 
-	~PacketPart() {
-		clear();
+	void setWindow(std::chrono::milliseconds window) {
+		window_ = (uint32_t)window.count();
+	}
+
+	void clear() {
+		memset(buckets_, 0, sizeof(Bucket) * BUCKETS_COUNT);
+	}
+
+	// Fingerprint of a fragment: HashBlock with the fragment index (see Packet)
+	static uint64_t fingerprint(const char* hashBlock, uint16_t index) {
+		uint64_t result = 0x9E3779B97F4A7C15ull ^ index;
+		for (size_t i = 0; i + sizeof(uint64_t) <= hash_length; i += sizeof(uint64_t)) {
+			uint64_t word;
+			memcpy(&word, hashBlock + i, sizeof(word));
+			result = (result ^ word) * 0xFF51AFD7ED558CCDull;
+			result ^= result >> 32;
+		}
+
+		result ^= result >> 33;
+		result *= 0xC4CEB9FE1A85EC53ull;
+		result ^= result >> 33;
+		return result ? result : 1;
+	}
+
+	uint32_t pushAndIncrease(const uint64_t fingerprint) {
+		const uint32_t now = window_ ? (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - epoch_).count() : ++ticks_;
+		Slot* const candidates[] = {
+			buckets_[fingerprint & (BUCKETS_COUNT - 1)].slots,
+			buckets_[(fingerprint >> 32) & (BUCKETS_COUNT - 1)].slots
+		};
+
+		// Expired and empty slots go first, taken from the emptier bucket, then the oldest one
+		Slot* victim = nullptr;
+		uint32_t victimAge = 0;
+		size_t victimFree = 0;
+		for (Slot* slots : candidates) {
+			Slot* oldest = nullptr;
+			uint32_t oldestAge = 0;
+			size_t free = 0;
+
+			for (Slot* slot = slots; slot != slots + BUCKET_SIZE; ++slot) {
+				const uint32_t age = now - slot->stamp;
+				const bool live = slot->fingerprint && (!window_ || age <= window_);
+				if (live && slot->fingerprint == fingerprint)
+					return ++(slot->count);
+
+				const uint32_t rank = live ? age : UINT32_MAX;
+				free += !live;
+				if (!oldest || rank > oldestAge) {
+					oldest = slot;
+					oldestAge = rank;
+				}
+			}
+
+			if (!victim || free > victimFree || (free == victimFree && oldestAge > victimAge)) {
+				victim = oldest;
+				victimAge = oldestAge;
+				victimFree = free;
+			}
+		}
+
+		victim->fingerprint = fingerprint;
+		victim->count = 1;
+		victim->stamp = now;
+		return 1;
+	}
+
+private:
+	static constexpr size_t BUCKET_SIZE = 4;
+
+	// Keeps the table at most half full
+	static constexpr size_t bucketsFor(size_t slots, size_t result = 1) {
+		return result * BUCKET_SIZE >= slots ? result : bucketsFor(slots, result * 2);
+	}
+	static constexpr size_t BUCKETS_COUNT = bucketsFor(Capacity * 2);
+
+	struct Slot {
+		uint64_t fingerprint;	// 0 marks an empty slot
+		uint32_t count;
+		uint32_t stamp;		// Milliseconds since epoch_ with a window, insertion number without
+	};
+
+	struct Bucket {
+		Slot slots[BUCKET_SIZE];
+	};
+	static_assert(sizeof(Bucket) == 64, "A bucket should fill one cache line");
+
+	std::unique_ptr<char[]> mem_;
+	Bucket* buckets_;
+
+	Clock::time_point epoch_;
+	uint32_t window_ = 0;
+	uint32_t ticks_ = 0;
+};
+
+// Appends the FEC parity fragments of a multi-fragment message, see fecParityCount.
+// alloc(dataSize) provides the packets, lastSize is the data size of the last fragment
+template <typename Alloc>
+void addFecParity(std::vector<PacketPtr>& packets, const size_t lastSize, Alloc alloc) {
+	const size_t count = packets.size();
+	if (!fecParityCount(count)) return;
+
+	packets.reserve(count + fecParityCount(count));
+	for (size_t begin = 0; begin < count - 1; begin += FEC_GROUP_SIZE) {
+		const size_t end = std::min(begin + FEC_GROUP_SIZE, count - 1);
+
+		PacketPtr parity = alloc(max_length);
+		memcpy(parity.get(), packets[begin].get(), sizeof(Packet));
+		for (size_t i = begin + 1; i < end; ++i)
+			xorFragment(parity->data, packets[i]->data, max_length);
+
+		parity->header = (uint16_t)packets.size();
+		packets.push_back(parity);
 	}
 
-	PacketPtr* packets;
+	PacketPtr copy = alloc(lastSize);
+	memcpy(copy.get(), packets[count - 1].get(), Packet::headerLength() + lastSize);
+	copy->header = (uint16_t)packets.size();
+	packets.push_back(copy);
+}
+
+// Fragments of one message. Slots [0, count) hold the data fragments; when the whole
+// sequence fits, the FEC parity fragments follow them (see fecParityCount). The slots
+// are allocated with the message, as long as it is being collected
+struct PacketPart {
+	PacketPart(size_t dataCount, size_t maxSize) :
+		left(dataCount),
+		size(dataCount + (dataCount + fecParityCount(dataCount) <= maxSize ? fecParityCount(dataCount) : 0)),
+		count(dataCount),
+		packets(new PacketPtr[size]) { }
+
 	size_t totalSize = 0;
 	size_t left;
 	size_t size;
+	size_t count;
+	std::unique_ptr<PacketPtr[]> packets;
+
+	// True when the message got a new data fragment, received or rebuilt
+	template <typename Alloc>
+	bool tryInsert(PacketPtr pack, const size_t size, Alloc alloc) {
+		const size_t index = pack->header;
+		if (index >= this->size || left == 0) return false;
 
-	bool tryInsert(PacketPtr pack, const size_t size) {
-		auto& target = packets[pack->header];
+		auto& target = packets[index];
 		if (target) return false;
 		
+		const size_t before = left;
 		target = pack;
-		totalSize += size;
-		--left;
-		return true;
+
+		if (index < count) {
+			totalSize += size;
+			--left;
+			recover(index, alloc);
+		}
+		else if (index + 1 < this->size)
+			recover((index - count) * FEC_GROUP_SIZE, alloc);
+		else if (!packets[count - 1]) {
+			// A copy of the last data fragment
+			packets[count - 1] = pack;
+			totalSize += size;
+			--left;
+		}
+
+		return left != before;
 	}
 
+	// Drops the fragments; a complete message keeps ignoring its late copies
 	void clear() {
-		PacketPtr* end = packets + size;
-		for (PacketPtr* ptr = packets; ptr != end; ++ptr)
-			*ptr = PacketPtr();
+		for (size_t i = 0; i < size; ++i)
+			packets[i] = PacketPtr();
+	}
+
+private:
+	// Rebuilds the only missing full fragment of the group of `index` from the group parity
+	template <typename Alloc>
+	void recover(const size_t index, Alloc alloc) {
+		if (left == 0 || size == count || index + 1 >= count) return;
+
+		const size_t group = index / FEC_GROUP_SIZE;
+		const size_t begin = group * FEC_GROUP_SIZE;
+		const size_t end = std::min(begin + FEC_GROUP_SIZE, count - 1);
+
+		const PacketPtr& parity = packets[count + group];
+		if (!parity) return;
+
+		size_t missing = end;
+		for (size_t i = begin; i < end; ++i) {
+			if (packets[i]) continue;
+			if (missing != end) return;
+			missing = i;
+		}
+		if (missing == end) return;
+
+		PacketPtr rebuilt = alloc();
+		memcpy(rebuilt.get(), parity.get(), sizeof(Packet));
+		for (size_t i = begin; i < end; ++i)
+			if (i != missing)
+				xorFragment(rebuilt->data, packets[i]->data, max_length);
+
+		rebuilt->header = (uint16_t)missing;
+		packets[missing] = rebuilt;
+		totalSize += max_length;
+		--left;
 	}
 };
 
@@ -88,41 +283,29 @@ public:
 
 	PacketCollector() {
 		map_.reserve(Capacity);
-		sequences = (PacketPtr*)malloc(sizeof(PacketPtr) * Capacity * MaxSeqLength);
 	}
 
-	~PacketCollector() {
-		free(sequences);
-	}
-
-	std::pair<PacketPart*, bool> append(PacketPtr packet, const std::size_t dataSize) {
+	// alloc provides the packets for the fragments rebuilt from the FEC parity
+	template <typename Alloc>
+	std::pair<PacketPart*, bool> append(PacketPtr packet, const std::size_t dataSize, Alloc alloc) {
 		auto key = Key{ packet->HashBlock };
-		bool added = false;
 
 		auto place = map_.find(key);
 		if (place == map_.end()) {
-			PacketPtr* nextSeq;
-
 			if (queue_.size() == Capacity) {
-				auto oldestPack = map_.find(queue_.front());
-				nextSeq = oldestPack->second.packets;
-
-				map_.erase(oldestPack);
+				map_.erase(queue_.front());
 				queue_.pop_front();
 			}
-			else
-				nextSeq = sequences + (queue_.size() * MaxSeqLength);
 
 			queue_.push_back(key);
-			place = map_.insert(std::make_pair<Key, PacketPart>(std::move(key), PacketPart(nextSeq, packet->countHeader))).first;
+			place = map_.emplace(std::move(key), PacketPart(packet->countHeader, MaxSeqLength)).first;
 		}
 
-		return std::make_pair(&(place->second), place->second.tryInsert(packet, dataSize));
+		return std::make_pair(&(place->second), place->second.tryInsert(packet, dataSize, alloc));
 	}
 
 private:
 	MapType map_;
-	PacketPtr* sequences;
 	std::deque<Key> queue_;
 };
 
@@ -169,104 +352,568 @@ private:
 	std::deque<udp::endpoint> endpoints_;
 };
 
+// Chooses the peers a redirected packet goes to. With no fan-out every peer gets it
+// (flooding); otherwise a random subset of fan-out peers, log2(N) + 1 of N by default.
+class GossipSelector {
+public:
+	static const size_t AUTO_FANOUT = size_t(-1);
+
+	explicit GossipSelector(size_t fanout = 0, uint32_t seed = std::random_device()()) :
+		fanout_(fanout),
+		rng_(seed) { }
+
+	void setFanout(const size_t fanout) { fanout_ = fanout; }
+
+	size_t fanout(const size_t peers) const {
+		if (fanout_ == 0) return peers;
+		if (fanout_ != AUTO_FANOUT) return std::min(fanout_, peers);
+
+		size_t log = 0;
+		while ((size_t(1) << log) < peers) ++log;
+		return std::min(log + 1, peers);
+	}
+
+	template <typename Container, typename Func>
+	void select(const Container& peers, Func f) {
+		const size_t count = fanout(peers.size());
+		if (count == peers.size()) {
+			for (auto& peer : peers) f(peer);
+			return;
+		}
+
+		// Partial Fisher-Yates shuffle over the peer indices
+		indices_.resize(peers.size());
+		for (size_t i = 0; i < indices_.size(); ++i) indices_[i] = i;
+
+		for (size_t i = 0; i < count; ++i) {
+			std::uniform_int_distribution<size_t> dist(i, indices_.size() - 1);
+			std::swap(indices_[i], indices_[dist(rng_)]);
+			f(peers[indices_[i]]);
+		}
+	}
+
+private:
+	size_t fanout_;
+	std::mt19937 rng_;
+	std::vector<size_t> indices_;
+};
+
+// Outgoing traffic by urgency: the consensus messages between the confidants, the
+// transactions on their way to the main node and the bulk of the block broadcasts
+enum class TrafficClass : uint8_t {
+	Consensus,
+	Transactions,
+	Bulk
+};
+
+const size_t TRAFFIC_CLASSES = 3;
+
+// Small single-packet messages to the same peer, gathered during a flush window and sent
+// together in one Bundle datagram; a message with no company goes out as it is. The bundle
+// keeps the header of its first message, the entries carry what differs between them.
+// A bundle goes in the most urgent traffic class of its messages.
+class MessageCoalescer {
+public:
+	// Larger messages gain little from sharing a datagram
+	static bool fits(const size_t dataSize) {
+		return dataSize <= PACKET_CAPACITIES[1];
+	}
+
+	bool empty() const { return pending_.empty(); }
+
+	// alloc(dataSize) provides the bundles, send(packet, packetSize, endpoint, class) takes
+	// the ones full before the window ends. Returns true for the first message of a window
+	template <typename Alloc, typename Send>
+	bool add(const PacketPtr& message, const size_t dataSize, const udp::endpoint& ep, const TrafficClass cls, Alloc alloc, Send send) {
+		const bool first = pending_.empty();
+
+		auto place = pending_.find(ep);
+		if (place == pending_.end()) {
+			pending_.emplace(ep, Pending{ message, dataSize, PacketPtr(), 0, cls });
+			return first;
+		}
+
+		Pending& p = place->second;
+		if (!p.bundle) {
+			p.bundle = alloc(max_length);
+			memcpy(p.bundle.get(), p.message.get(), Packet::headerLength());
+			p.bundle->command = CommandList::Bundle;
+			p.bundle->subcommand = SubCommandList::Empty;
+			p.bundle->header = 0;
+			p.bundle->countHeader = 0;
+			append(p, *p.message, p.messageSize);
+		}
+
+		if (p.size + sizeof(BundleEntry) + dataSize > max_length) {
+			send(p.bundle, Packet::headerLength() + p.size, ep, p.cls);
+			p = Pending{ message, dataSize, PacketPtr(), 0, cls };
+			return false;
+		}
+
+		append(p, *message.get(), dataSize);
+		p.cls = std::min(p.cls, cls);
+		return false;
+	}
+
+	template <typename Send>
+	void flush(Send send) {
+		for (auto& item : pending_) {
+			const Pending& p = item.second;
+			if (p.bundle)
+				send(p.bundle, Packet::headerLength() + p.size, item.first, p.cls);
+			else
+				send(p.message, Packet::headerLength() + p.messageSize, item.first, p.cls);
+		}
+
+		pending_.clear();
+	}
+
+	// Calls f(packet, dataSize) with every message of the bundle as a packet of its own.
+	// False if the bundle is malformed; the messages before the broken entry are passed on
+	template <typename Alloc, typename Func>
+	static bool unbundle(const Packet& bundle, const size_t dataSize, Alloc alloc, Func f) {
+		size_t pos = 0;
+		while (pos < dataSize) {
+			BundleEntry entry;
+			if (dataSize - pos < sizeof(entry)) return false;
+
+			memcpy(&entry, bundle.data + pos, sizeof(entry));
+			pos += sizeof(entry);
+			if (dataSize - pos < entry.size || entry.command == CommandList::Bundle) return false;
+
+			PacketPtr message = alloc(entry.size);
+			memcpy(message.get(), &bundle, Packet::headerLength());
+			message->command = entry.command;
+			message->subcommand = entry.subcommand;
+			memcpy(message->HashBlock, entry.HashBlock, hash_length);
+			memcpy(message->data, bundle.data + pos, entry.size);
+			pos += entry.size;
+
+			f(message, (size_t)entry.size);
+		}
+
+		return true;
+	}
+
+private:
+	struct Pending {
+		PacketPtr message;
+		size_t messageSize;
+		PacketPtr bundle;	// Made once a second message comes
+		size_t size;
+		TrafficClass cls;
+	};
+
+	static void append(Pending& p, const Packet& message, const size_t dataSize) {
+		BundleEntry entry;
+		entry.command = message.command;
+		entry.subcommand = message.subcommand;
+		memcpy(entry.HashBlock, message.HashBlock, hash_length);
+		entry.size = (uint16_t)dataSize;
+
+		memcpy(p.bundle->data + p.size, &entry, sizeof(entry));
+		memcpy(p.bundle->data + p.size + sizeof(entry), message.data, dataSize);
+		p.size += sizeof(entry) + dataSize;
+	}
+
+	std::unordered_map<udp::endpoint, Pending> pending_;
+};
+
+// Per-class send queues. The classes share the link by weight, as in start-time fair
+// queueing: the next datagram comes from the class that has sent the fewest bytes for its
+// weight, and a class waking up from idle gets no credit for the time it was idle. A
+// class may also be paced with a token bucket, which lets it burst for 10 ms.
+template <typename Item>
+class SendScheduler {
+public:
+	SendScheduler() {
+		setWeight(TrafficClass::Consensus, 8);
+		setWeight(TrafficClass::Transactions, 4);
+		setWeight(TrafficClass::Bulk, 1);
+	}
+
+	void setWeight(const TrafficClass cls, const unsigned weight) {
+		classes_[(size_t)cls].weight = std::max(1u, weight);
+	}
+
+	// Bytes per second, 0 leaves the class unpaced
+	void setRate(const TrafficClass cls, const size_t rate) {
+		Class& c = classes_[(size_t)cls];
+		c.rate = rate;
+		c.burst = std::max<int64_t>(rate / 100, sizeof(Packet));
+		c.tokens = c.burst;
+		c.refilled = Clock::now();
+	}
+
+	bool empty() const {
+		for (auto& c : classes_)
+			if (!c.queue.empty()) return false;
+		return true;
+	}
+
+	void push(const TrafficClass cls, Item&& item, const size_t size) {
+		Class& c = classes_[(size_t)cls];
+		if (c.queue.empty())
+			c.pass = std::max(c.pass, virtualTime_);
+		c.queue.push_back(Entry{ std::move(item), size });
+	}
+
+	// Passes up to count items to f in the order they should go out; the classes over
+	// their rate wait. Returns the number of items passed
+	template <typename Func>
+	size_t pop(const Clock::time_point now, const size_t count, Func f) {
+		for (auto& c : classes_)
+			refill(c, now);
+
+		size_t result = 0;
+		while (result < count) {
+			Class* next = nullptr;
+			for (auto& c : classes_)
+				if (!c.queue.empty() && (!c.rate || c.tokens > 0) && (!next || c.pass < next->pass))
+					next = &c;
+			if (!next) break;
+
+			Entry& e = next->queue.front();
+			virtualTime_ = next->pass;
+			next->pass += e.size * WEIGHT_SCALE / next->weight;
+			if (next->rate)
+				next->tokens -= e.size;
+
+			f(std::move(e.item));
+			next->queue.pop_front();
+			++result;
+		}
+
+		return result;
+	}
+
+	// When a paced class may send again, now if some class may send already
+	Clock::time_point nextTime(const Clock::time_point now) const {
+		Clock::time_point result = Clock::time_point::max();
+		for (auto& c : classes_) {
+			if (c.queue.empty()) continue;
+			if (!c.rate || c.tokens > 0) return now;
+
+			const auto wait = std::chrono::microseconds((-c.tokens + 1) * 1000000 / c.rate + 1);
+			result = std::min(result, c.refilled + std::chrono::duration_cast<Clock::duration>(wait));
+		}
+
+		return result;
+	}
+
+private:
+	static const uint64_t WEIGHT_SCALE = 1 << 16;
+
+	struct Entry {
+		Item item;
+		size_t size;
+	};
+
+	struct Class {
+		std::deque<Entry> queue;
+		unsigned weight = 1;
+		uint64_t pass = 0;
+
+		size_t rate = 0;
+		int64_t burst = 0;
+		int64_t tokens = 0;
+		Clock::time_point refilled;
+	};
+
+	static void refill(Class& c, const Clock::time_point now) {
+		if (!c.rate || now <= c.refilled) return;
+
+		const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - c.refilled).count();
+		const int64_t added = elapsed * (int64_t)c.rate / 1000000;
+		if (!added) return;
+
+		c.tokens = std::min(c.burst, c.tokens + added);
+		c.refilled = now;
+	}
+
+	Class classes_[TRAFFIC_CLASSES];
+	uint64_t virtualTime_ = 0;
+};
+
 const auto BROADCAST_INIT_TIMEOUT = std::chrono::milliseconds(2);
 const auto DIRECT_INIT_TIMEOUT = std::chrono::milliseconds(2);
+const auto MIN_TIMEOUT = std::chrono::milliseconds(1);
 const auto MAX_TIMEOUT = std::chrono::milliseconds(1024);
 
+// Round-trip time to a peer and the retransmission timeout derived from it after Jacobson
+// and Karels (RFC 6298): the smoothed RTT and its mean deviation, updated with the gains of
+// 1/8 and 1/4, give RTO = SRTT + 4 * RTTVAR. Until the first sample the timeout is the
+// initial one of the direct tasks
+class RttEstimator {
+public:
+	void sample(const Clock::duration rtt) {
+		const auto r = std::max<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(rtt).count(), 0);
+
+		if (!samples_) {
+			srtt_ = r;
+			rttvar_ = r / 2;
+		}
+		else {
+			rttvar_ += (std::abs(srtt_ - r) - rttvar_) / 4;
+			srtt_ += (r - srtt_) / 8;
+		}
+
+		++samples_;
+	}
+
+	uint64_t samples() const { return samples_; }
+	std::chrono::microseconds srtt() const { return std::chrono::microseconds(srtt_); }
+	std::chrono::microseconds rttvar() const { return std::chrono::microseconds(rttvar_); }
+
+	std::chrono::microseconds rto() const {
+		if (!samples_) return DIRECT_INIT_TIMEOUT;
+
+		const std::chrono::microseconds result(srtt_ + 4 * rttvar_);
+		return std::min<std::chrono::microseconds>(std::max<std::chrono::microseconds>(result, MIN_TIMEOUT), MAX_TIMEOUT);
+	}
+
+private:
+	int64_t srtt_ = 0;
+	int64_t rttvar_ = 0;
+	uint64_t samples_ = 0;
+};
+
 struct Task {
-	Task(std::vector<PacketPtr>&& packs, size_t size, udp::endpoint&& ep) :
+	Task(std::vector<PacketPtr>&& packs, size_t size, udp::endpoint&& ep, TrafficClass cls = TrafficClass::Consensus) :
 		nextLaunch(Clock::now()),
 		timeout(DIRECT_INIT_TIMEOUT),
 		packets(std::move(packs)),
 		lastSize(Packet::headerLength() + size),
 		receivers(1, std::move(ep)),
-		broadcast(false) { }
+		broadcast(false),
+		trafficClass(cls),
+		shortIndex(packets.size() - 1) { }
 
-	Task(std::vector<PacketPtr>&& packs, size_t size, const std::deque<udp::endpoint>& recvs) :
+	Task(std::vector<PacketPtr>&& packs, size_t size, const std::deque<udp::endpoint>& recvs, TrafficClass cls = TrafficClass::Consensus) :
 		nextLaunch(Clock::now()),
 		timeout(BROADCAST_INIT_TIMEOUT),
 		packets(std::move(packs)),
 		lastSize(Packet::headerLength() + size),
 		receivers(recvs.begin(), recvs.end()),
-		broadcast(true) { }
+		broadcast(true),
+		trafficClass(cls),
+		shortIndex(packets.size() - 1) { }
 
 	Clock::time_point nextLaunch;
-	std::chrono::milliseconds timeout;
+	std::chrono::microseconds timeout;
+
+	// An Ack of a message sent once gives an RTT sample (Karn's algorithm)
+	Clock::time_point firstLaunch;
+	uint32_t launches = 0;
+	bool sampled = false;
 
 	std::vector<PacketPtr> packets;
 	std::size_t lastSize;
 
 	std::vector<ip::udp::endpoint> receivers;
 	bool broadcast;
+	TrafficClass trafficClass;
+
+	// Index of the last data fragment; FEC parity fragments may follow it
+	std::size_t shortIndex;
+
+	// Fragments the receiver still misses, as reported by a Nack; empty means all of them
+	std::vector<bool> missing;
 };
 
-typedef std::list<Task>::iterator TaskId;
+// Handle of a scheduled entry. It stays valid until the entry is removed;
+// a handle of a removed entry is ignored, even if its slot was reused
+struct TaskId {
+	uint32_t slot = 0;
+	uint32_t generation = 0;
+};
 
+// Indexed min-heap of the retransmission tasks and the node timers, ordered by launch time
 class TaskManager {
 public:
-	TaskManager(): 
-		nextTime_(Clock::now()) { }
-
-	void stop() { running_ = false; }
-
 	TaskId add(Task&& t) {
-		TaskId result;
-
-		{
-			
+		std::lock_guard<std::mutex> lock(mut_);
 
-			if (tasks_.empty() || t.nextLaunch < nextTime_)
-				nextTime_ = t.nextLaunch;
+		const auto when = t.nextLaunch;
+		const uint32_t slot = allocate(when);
+		entries_[slot].task.reset(new Task(std::move(t)));
+		return TaskId{ slot, entries_[slot].generation };
+	}
 
-			tasks_.emplace_front(std::move(t));
-			result = tasks_.begin();
-		}
+	TaskId addTimer(const Clock::time_point when, std::function<void()> callback) {
+		std::lock_guard<std::mutex> lock(mut_);
 
-		cv_.notify_all();
-		return result;
+		const uint32_t slot = allocate(when);
+		entries_[slot].callback = std::move(callback);
+		return TaskId{ slot, entries_[slot].generation };
 	}
 
 	void remove(const TaskId id) {
-		
-		tasks_.erase(id);
+		std::lock_guard<std::mutex> lock(mut_);
+
+		if (id.slot < entries_.size() && entries_[id.slot].generation == id.generation && entries_[id.slot].used)
+			release(id.slot);
 	}
 
+	// Drops the retransmission tasks, the node timers stay
 	void clear() {
-		
-		tasks_.clear();
+		std::lock_guard<std::mutex> lock(mut_);
+
+		for (uint32_t slot = 0; slot < entries_.size(); ++slot)
+			if (entries_[slot].used && entries_[slot].task)
+				release(slot);
 	}
 
+	// Calls f with the task under the lock, false if the handle is stale
 	template <typename Func>
-	void run(Func f) {
-		if (nextTime_ > Clock::now()) return;
-		
-			bool wroteNewNT = false;
-			{
-				
-				for (auto& t : tasks_) {
-					if (t.nextLaunch <= Clock::now()) {
-						f(t);
-						t.nextLaunch += t.timeout;
-
-						if (t.timeout == MAX_TIMEOUT)
-							t.timeout = t.broadcast ? BROADCAST_INIT_TIMEOUT : DIRECT_INIT_TIMEOUT;
-						else
-							t.timeout *= 4;
-					}
-
-					if (!wroteNewNT || t.nextLaunch < nextTime_)
-						nextTime_ = t.nextLaunch;
-				}
+	bool update(const TaskId id, Func f) {
+		std::lock_guard<std::mutex> lock(mut_);
+
+		if (id.slot >= entries_.size() || entries_[id.slot].generation != id.generation || !entries_[id.slot].task)
+			return false;
+
+		f(*entries_[id.slot].task);
+		return true;
+	}
 
+	bool empty() const {
+		std::lock_guard<std::mutex> lock(mut_);
+		return heap_.empty();
+	}
+
+	// The earliest launch time, valid when there are any entries
+	Clock::time_point nextTime() const {
+		std::lock_guard<std::mutex> lock(mut_);
+		return heap_.empty() ? Clock::time_point::max() : entries_[heap_.front()].when;
+	}
+
+	// Launches the due tasks with f and fires the due timers. The timers are
+	// called without the lock held, so they may schedule new entries.
+	template <typename Func>
+	void run(Func f) {
+		std::unique_lock<std::mutex> lock(mut_);
+		const auto now = Clock::now();
+
+		while (!heap_.empty()) {
+			const uint32_t slot = heap_.front();
+			Entry& e = entries_[slot];
+			if (e.when > now) break;
+
+			if (!e.task) {
+				std::function<void()> callback = std::move(e.callback);
+				release(slot);
+
+				lock.unlock();
+				callback();
+				lock.lock();
+				continue;
 			}
+
+			Task& t = *e.task;
+			if (!t.launches++)
+				t.firstLaunch = now;
+
+			f(t);
+			t.nextLaunch += t.timeout;
+			if (t.nextLaunch <= now)
+				t.nextLaunch = now + t.timeout;
+
+			// Exponential backoff up to the limit, where the task stays
+			t.timeout = std::min<std::chrono::microseconds>(t.timeout * 2, MAX_TIMEOUT);
+
+			e.when = t.nextLaunch;
+			siftDown(e.heapPos);
+		}
 	}
 
 private:
-	std::mutex mut_;
-	std::condition_variable cv_;
+	struct Entry {
+		Clock::time_point when;
+		size_t heapPos = 0;
+		uint32_t generation = 0;
+		bool used = false;
+
+		std::unique_ptr<Task> task;
+		std::function<void()> callback;
+	};
+
+	uint32_t allocate(const Clock::time_point when) {
+		uint32_t slot;
+		if (free_.empty()) {
+			slot = static_cast<uint32_t>(entries_.size());
+			entries_.emplace_back();
+		}
+		else {
+			slot = free_.back();
+			free_.pop_back();
+		}
+
+		Entry& e = entries_[slot];
+		e.when = when;
+		e.used = true;
+		e.heapPos = heap_.size();
+		heap_.push_back(slot);
+		siftUp(e.heapPos);
+
+		return slot;
+	}
+
+	void release(const uint32_t slot) {
+		Entry& e = entries_[slot];
+		const size_t pos = e.heapPos;
+
+		e.used = false;
+		++e.generation;
+		e.task.reset();
+		e.callback = nullptr;
+		free_.push_back(slot);
+
+		const uint32_t moved = heap_.back();
+		heap_.pop_back();
+		if (pos == heap_.size()) return;
+
+		heap_[pos] = moved;
+		entries_[moved].heapPos = pos;
+		siftUp(pos);
+		siftDown(entries_[moved].heapPos);
+	}
+
+	void siftUp(size_t pos) {
+		const uint32_t slot = heap_[pos];
+		while (pos > 0) {
+			const size_t parent = (pos - 1) / 2;
+			if (!(entries_[slot].when < entries_[heap_[parent]].when)) break;
+
+			place(pos, heap_[parent]);
+			pos = parent;
+		}
+		place(pos, slot);
+	}
+
+	void siftDown(size_t pos) {
+		const uint32_t slot = heap_[pos];
+		const size_t size = heap_.size();
+		for (;;) {
+			size_t child = pos * 2 + 1;
+			if (child >= size) break;
+			if (child + 1 < size && entries_[heap_[child + 1]].when < entries_[heap_[child]].when)
+				++child;
+			if (!(entries_[heap_[child]].when < entries_[slot].when)) break;
+
+			place(pos, heap_[child]);
+			pos = child;
+		}
+		place(pos, slot);
+	}
+
+	void place(const size_t pos, const uint32_t slot) {
+		heap_[pos] = slot;
+		entries_[slot].heapPos = pos;
+	}
 
-	std::atomic_bool running_{true};
+	mutable std::mutex mut_;
 
-	Clock::time_point nextTime_;
-	std::list<Task> tasks_;
+	std::vector<Entry> entries_;
+	std::vector<uint32_t> heap_;
+	std::vector<uint32_t> free_;
 };
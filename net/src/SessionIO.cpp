@@ -4,6 +4,15 @@
 #include <chrono>
 #include <thread>
 #include <atomic>
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+
+#ifdef __linux__
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
 
 #include <csnode/Node.hpp>
 
@@ -19,8 +28,13 @@ const unsigned CLOSE_TIMEOUT_SEC = 10;
 
 const unsigned MAX_REDIRECT = 1;
 
+const unsigned IO_BATCH_SIZE = 32;
+
+#ifdef SO_REUSEPORT
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+#endif
+
 std::atomic_bool SessionIO::AwaitingRegistration{true};
-std::function<void(PacketPtr*)> PacketPtr::freeFunc = [](PacketPtr*) { };
 
 using namespace std::placeholders;
 SessionIO::SessionIO() : InputServiceResolver_(io_service_client_), 
@@ -32,11 +46,24 @@ SessionIO::SessionIO() : InputServiceResolver_(io_service_client_),
 	}
 }
 
-SessionIO::~SessionIO() {
-	free(m_combinedData);
+SessionIO::ReceiveShard::~ReceiveShard() {
+	stop();
+}
+
+void SessionIO::ReceiveShard::stop() {
+	io.stop();
+	if (thread.joinable())
+		thread.join();
+
+	if (deferred) {
+		delete socket;
+		socket = nullptr;
+	}
+}
 
-	m_taskman.stop();
-	m_senderThread.join();
+SessionIO::~SessionIO() {
+	for (auto& shard : m_shards)
+		shard->stop();
 }
 
 bool SessionIO::Initialization() {
@@ -47,9 +74,20 @@ bool SessionIO::Initialization() {
 	const boost::property_tree::ptree & host_Input = config.get_child("hostInput");
 	udp::resolver::query query_send(udp::v4(), host_Input.get<std::string>("ip"), host_Input.get<std::string>("port", "9001"));
 	InputServiceRecvEndpoint_ = *InputServiceResolver_.resolve(query_send);
-	InputServiceSocket_ = new udp::socket(io_service_client_, InputServiceRecvEndpoint_);
-	boost::asio::ip::udp::socket::receive_buffer_size recvBuff(65536);
+
+#ifdef SO_REUSEPORT
+	receiveThreads_ = std::max(1u, config.get<unsigned>("network.receiveThreads", 1));
+#endif
+
+	// All the sockets of the SO_REUSEPORT group must set the option before binding
+	InputServiceSocket_ = new udp::socket(io_service_client_, InputServiceRecvEndpoint_.protocol());
 	InputServiceSocket_->set_option(boost::asio::ip::udp::socket::reuse_address(true));
+#ifdef SO_REUSEPORT
+	if (receiveThreads_ > 1)
+		InputServiceSocket_->set_option(reuse_port(true));
+#endif
+	InputServiceSocket_->bind(InputServiceRecvEndpoint_);
+	boost::asio::ip::udp::socket::receive_buffer_size recvBuff(65536);
 	InputServiceSocket_->set_option(recvBuff);
 
 	const boost::property_tree::ptree & host_Output = config.get_child("hostOutput");
@@ -66,10 +104,33 @@ bool SessionIO::Initialization() {
 
 	signalServerAddr = OutputServiceServerEndpoint_.address();
 
+#ifdef __linux__
+	batchedIO_ = config.get<bool>("network.batchedIO", true);
+#endif
+	measureWakeups_ = config.get<bool>("network.measureWakeups", false);
+	selectiveAck_ = config.get<bool>("network.selectiveAck", false);
+	fec_ = config.get<bool>("network.fec", false);
+	compactBlocks_ = config.get<bool>("network.compactBlocks", false);
+	if (config.get<bool>("network.gossip", false)) {
+		const auto fanout = config.get<size_t>("network.gossipFanout", 0);
+		m_gossip.setFanout(fanout ? fanout : GossipSelector::AUTO_FANOUT);
+	}
+	m_sendQueues.setRate(TrafficClass::Consensus, config.get<size_t>("network.consensusRate", 0) * 1024);
+	m_sendQueues.setRate(TrafficClass::Transactions, config.get<size_t>("network.transactionsRate", 0) * 1024);
+	m_sendQueues.setRate(TrafficClass::Bulk, config.get<size_t>("network.bulkRate", 0) * 1024);
+	coalesce_ = config.get<bool>("network.coalesce", false);
+	coalesceWindow_ = std::chrono::microseconds(config.get<unsigned>("network.coalesceWindow", 200));
+	dedupWindow_ = std::chrono::milliseconds(config.get<unsigned>("network.dedupWindow", 0));
+	m_mainShard.backData.setWindow(dedupWindow_);
+
+	if (batchedIO_) {
+		InputServiceSocket_->non_blocking(true);
+		OutputServiceSocket_->non_blocking(true);
+	}
+
 
 	// Initialize resources
-	m_combinedData = (char*)malloc(MAX_PART * max_length);
-	if (!m_combinedData) return false;
+	m_mainShard.socket = InputServiceSocket_;
 
 	MyIp_ = InputServiceRecvEndpoint_.address();
 	if (!GenerationHash()) return false;
@@ -130,84 +191,244 @@ void SessionIO::ReceiveRegistration() {
 }
 
 void SessionIO::StartReceive() {
+	if (receiveThreads_ > 1 && startShards()) {
+		// The shards took over the port, the main loop only consumes their messages
+		InputServiceSocket_->close();
+		return;
+	}
+
+	StartReceive(m_mainShard);
+}
+
+bool SessionIO::startShards() {
+	for (unsigned i = 0; i < receiveThreads_; ++i) {
+		std::unique_ptr<ReceiveShard> shard(new ReceiveShard);
+
+		boost::system::error_code ec;
+		shard->deferred = true;
+		shard->backData.setWindow(dedupWindow_);
+		shard->socket = new udp::socket(shard->io, InputServiceRecvEndpoint_.protocol());
+		shard->socket->set_option(boost::asio::ip::udp::socket::reuse_address(true), ec);
+#ifdef SO_REUSEPORT
+		if (!ec) shard->socket->set_option(reuse_port(true), ec);
+#endif
+		if (!ec) shard->socket->bind(InputServiceRecvEndpoint_, ec);
+		if (!ec) shard->socket->set_option(boost::asio::ip::udp::socket::receive_buffer_size(65536), ec);
+		if (!ec && batchedIO_) shard->socket->non_blocking(true, ec);
+
+		if (ec) {
+			LOG_ERROR("Cannot open receive socket #" << i << ": " << ec.message());
+			break;
+		}
+
+		m_shards.push_back(std::move(shard));
+	}
+
+	if (m_shards.size() != receiveThreads_) {
+		LOG_WARN("Falling back to the single receive socket");
+		m_shards.clear();
+		return false;
+	}
+
+	for (auto& shard : m_shards) {
+		ReceiveShard* sh = shard.get();
+		StartReceive(*sh);
+		sh->thread = std::thread([sh] { sh->io.run(); });
+	}
+
+	LOG_NOTICE("Receiving on " << m_shards.size() << " sockets");
+	return true;
+}
+
+void SessionIO::StartReceive(ReceiveShard& shard) {
+	if (batchedIO_) {
+		shard.socket->async_wait(udp::socket::wait_read,
+			[this, &shard] (const boost::system::error_code& error) {
+				if (error)
+					std::cerr << "Receive error: " << error << std::endl;
+				else
+					receiveBatch(shard);
+				StartReceive(shard);
+			});
+		return;
+	}
+
 	PacketPtr nextPack = m_pacman.getFreePack();
 
-	InputServiceSocket_->async_receive_from(
+	shard.socket->async_receive_from(
 			boost::asio::buffer(nextPack.get(), sizeof(Packet)),
-			InputServiceSendEndpoint_,
-			[this, nextPack] (const boost::system::error_code& error, std::size_t bytes_transferred) {
+			shard.sender,
+			[this, &shard, nextPack] (const boost::system::error_code& error, std::size_t bytes_transferred) {
 				LOG_IN_PACK(nextPack, bytes_transferred);
-				InputServiceHandleReceive(nextPack, error, bytes_transferred);
-				StartReceive();
+				InputServiceHandleReceive(shard, nextPack, error, bytes_transferred);
+				StartReceive(shard);
 			});
 }
 
-inline void SessionIO::InputServiceHandleReceive(PacketPtr message, const boost::system::error_code& error, std::size_t bytes_transferred) {
+void SessionIO::receiveBatch(ReceiveShard& shard) {
+#ifdef __linux__
+	PacketPtr packs[IO_BATCH_SIZE];
+	mmsghdr msgs[IO_BATCH_SIZE];
+	iovec iovs[IO_BATCH_SIZE];
+	sockaddr_storage addrs[IO_BATCH_SIZE];
+
+	memset(msgs, 0, sizeof(msgs));
+	for (unsigned i = 0; i < IO_BATCH_SIZE; ++i) {
+		packs[i] = m_pacman.getFreePack();
+		iovs[i].iov_base = packs[i].get();
+		iovs[i].iov_len = sizeof(Packet);
+		msgs[i].msg_hdr.msg_name = &addrs[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	const int received = recvmmsg(shard.socket->native_handle(), msgs, IO_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+	if (received < 0) {
+		if (errno == ENOSYS) {
+			LOG_WARN("recvmmsg is not supported, switching to the per-packet I/O");
+			batchedIO_ = false;
+		}
+		else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			LOG_ERROR("Receive error: " << strerror(errno));
+		return;
+	}
+
+	for (int i = 0; i < received; ++i) {
+		memcpy(shard.sender.data(), &addrs[i], msgs[i].msg_hdr.msg_namelen);
+		shard.sender.resize(msgs[i].msg_hdr.msg_namelen);
+
+		LOG_IN_PACK(packs[i], msgs[i].msg_len);
+		InputServiceHandleReceive(shard, packs[i], boost::system::error_code(), msgs[i].msg_len);
+	}
+#endif
+}
+
+inline void SessionIO::InputServiceHandleReceive(ReceiveShard& shard, PacketPtr message, const boost::system::error_code& error, std::size_t bytes_transferred) {
 	if (error) {
 		std::cerr << "Receive error: " << error << std::endl;
 		return;
 	}
 	
-	addToRingBuffer(InputServiceSendEndpoint_.address());
+	noteSender(shard);
+
+	// A short message moves to a packet of its size and the full one goes back to the receive
+	// pool. Fragments the FEC may read in full keep theirs
+	if (message->countHeader == 0 || message->header + 1 == message->countHeader)
+		message = m_pacman.shrink(message, bytes_transferred);
+
+	const std::size_t size = bytes_transferred - Packet::headerLength();
+	if (message->command == CommandList::Bundle) {
+		auto alloc = [this] (std::size_t dataSize) { return m_pacman.getFreePack(dataSize); };
+		if (!MessageCoalescer::unbundle(*message, size, alloc, [this, &shard] (PacketPtr inner, std::size_t innerSize) { handleMessage(shard, inner, innerSize); }))
+			LOG_WARN("Malformed bundle from " << shard.sender.address());
+		return;
+	}
 
+	handleMessage(shard, message, size);
+}
+
+void SessionIO::handleMessage(ReceiveShard& shard, PacketPtr message, std::size_t size) {
 	bool multiPack = false;
-	char* dataPtr = message->data;
-	std::size_t size = bytes_transferred - Packet::headerLength();
+	std::vector<PacketPtr> parts;
+	MessageData data{ &message, 1, size };
+
+	if (message->command == CommandList::Ack || message->command == CommandList::Nack) {
+		if (shard.deferred)
+			io_service_client_.post([this, message, size] { handleAck(*message.get(), size); });
+		else
+			handleAck(*message, size);
+		return;
+	}
+
+	// The kernel spreads the datagrams over the shards by sender, so the fragments and the
+	// copies of a message move on to the shard its HashBlock picks. That one collects them,
+	// filters the copies and redirects each fragment once
+	if (shard.deferred) {
+		ReceiveShard& owner = *m_shards[DedupFilter<50000>::fingerprint(message->HashBlock, 0) % m_shards.size()];
+		if (&owner != &shard) {
+			owner.io.post([this, &owner, message, size] { handleMessage(owner, message, size); });
+			return;
+		}
+	}
+
+	const bool direct = (message->command != CommandList::Redirect);
 
 	//Combine parts
 	if (message->countHeader > 0) {
-		if (message->countHeader > MAX_PART || message->header >= message->countHeader)
+		if (message->countHeader > MAX_PART || message->header >= message->countHeader + fecParityCount(message->countHeader))
 			return; // Stay safe, memory
 
 		if (message->command == CommandList::Redirect)
-			RunRedirect(message, size);
+			RunRedirect(shard, message, size);
+
+		auto packResult = shard.packets.append(message, size, [this] { return m_pacman.getFreePack(); });
+
+		// The sender learns about the gaps once its last fragment or a repeated one arrives
+		if (direct && selectiveAck_ &&
+		    (!packResult.second || packResult.first->left == 0 || message->header + 1 == message->countHeader))
+			sendAck(shard, *message, packResult.first->left ? packResult.first : nullptr);
 
-		auto packResult = m_packets.append(message, size);
 		if (!packResult.second) return;
 
 		if (packResult.first->left != 0) return;
 
-		// Ok, we can combine, since left = 0
-		PacketPtr* last = packResult.first->packets + message->countHeader - 1;
-		char* writePtr = m_combinedData;
-		size_t total = packResult.first->totalSize;
-		for (PacketPtr* ptr = packResult.first->packets; ptr != last; ++ptr) {
-			memcpy(writePtr, (*ptr)->data, max_length);
-			total -= max_length;
-			writePtr += max_length;
-		}
-
-		memcpy(writePtr, (*last)->data, total);
+		// All the fragments are here, the Node reads them in place. The collector only
+		// keeps the entry to drop the late copies
+		PacketPtr* fragments = packResult.first->packets.get();
+		parts.assign(std::make_move_iterator(fragments), std::make_move_iterator(fragments + message->countHeader));
+		packResult.first->clear();
 
 		multiPack = true;
-		dataPtr = m_combinedData;
 		size = packResult.first->totalSize;
+		data = MessageData{ parts.data(), parts.size(), size };
+	}
+	else if (direct && selectiveAck_)
+		sendAck(shard, *message, nullptr);
+
+	if (message->command == CommandList::Redirect) {
+		if (!multiPack && !RunRedirect(shard, message, size))
+			return;
 	}
+	else if (getBackDataCounter(shard, message) > 1)
+		return;
 
-	if (message->command != CommandList::Redirect && getBackDataCounter(message) > 1)
+	if (!shard.deferred) {
+		deliverMessage(*message, data);
 		return;
+	}
 
-	switch (message->command) {
+	if (!multiPack)
+		parts.push_back(message);
+	io_service_client_.post([this, message, size, parts = std::move(parts)] {
+		deliverMessage(*message.get(), MessageData{ parts.data(), parts.size(), size });
+	});
+}
+
+void SessionIO::deliverMessage(const Packet& message, const MessageData& data) {
+	switch (message.command) {
 		case CommandList::Redirect:	
 		{
-			if (!multiPack && !RunRedirect(message, size))
-				return;
-
-			switch (message->subcommand) {
+			switch (message.subcommand) {
 				case SubCommandList::SGetIpTable:
 				{
-					node_->getRoundTable(dataPtr, size);
+					node_->getRoundTable(data);
 					break;
 				}
 				case SubCommandList::GetBlock:
 				{
-					node_->getBlock(dataPtr, size, ip::make_address_v4(message->origin_ip));
+					node_->getBlock(data, ip::make_address_v4(message.origin_ip));
+					break;
+				}
+				case SubCommandList::GetCompactBlock:
+				{
+					node_->getCompactBlock(data, ip::make_address_v4(message.origin_ip));
 					break;
 				}
 				case SubCommandList::RegistrationLevelNode: { break; }
 				default:
 				{
-					LOG_WARN("Unknown command received: " << (int)message->command << ":" << (int)message->subcommand << " from " << ip::make_address_v4(message->origin_ip));
+					LOG_WARN("Unknown command received: " << (int)message.command << ":" << (int)message.subcommand << " from " << ip::make_address_v4(message.origin_ip));
 					break;
 				}
 			}
@@ -215,46 +436,56 @@ inline void SessionIO::InputServiceHandleReceive(PacketPtr message, const boost:
 		}
 		case CommandList::GetBlockCandidate:
 		{
-			node_->getTransactionsList(dataPtr, size);
+			node_->getTransactionsList(data);
 			break;
 		}
 		case CommandList::GetTransaction:
 		{
-			node_->getTransaction(dataPtr, size);
+			node_->getTransaction(data);
 			break;
 		}
 		case CommandList::GetFirstTransaction:
 		{
-			node_->getFirstTransaction(dataPtr, size);
+			node_->getFirstTransaction(data);
 			break;
 		}
 		case CommandList::GetVector:
 		{
-			node_->getVector(dataPtr, size, ip::make_address_v4(message->origin_ip));
+			node_->getVector(data, ip::make_address_v4(message.origin_ip));
 			break;
 		}
 		case CommandList::GetMatrix:
 		{
-			node_->getMatrix(dataPtr, size, ip::make_address_v4(message->origin_ip));
+			node_->getMatrix(data, ip::make_address_v4(message.origin_ip));
 			break;
 		}
 		case CommandList::GetHash:
 		{
-			node_->getHash(dataPtr, size, ip::make_address_v4(message->origin_ip));
+			node_->getHash(data, ip::make_address_v4(message.origin_ip));
+			break;
+		}
+		case CommandList::GetBlockRequest:
+		{
+			node_->getBlockRequest(data, ip::make_address_v4(message.origin_ip));
+			break;
+		}
+		case CommandList::GetBlockReply:
+		{
+			node_->getBlockReply(data, ip::make_address_v4(message.origin_ip));
 			break;
 		}
 		case CommandList::SinhroPacket: { break; }
 		default:
 		{
-			LOG_WARN("Unknown command received: " << (int)message->command << ":" << (int)message->subcommand << " from " << ip::make_address_v4(message->origin_ip));
+			LOG_WARN("Unknown command received: " << (int)message.command << ":" << (int)message.subcommand << " from " << ip::make_address_v4(message.origin_ip));
 			break;
 		}
 	}
 }
 
 //Returns true if further processing needed
-inline bool SessionIO::RunRedirect(PacketPtr message, std::size_t dataSize) {
-	auto counter = getBackDataCounter(message);
+inline bool SessionIO::RunRedirect(ReceiveShard& shard, PacketPtr message, std::size_t dataSize) {
+	auto counter = getBackDataCounter(shard, message);
 
 	const bool needProcessing = (counter == 1);
 	if (counter > MAX_REDIRECT)
@@ -263,16 +494,135 @@ inline bool SessionIO::RunRedirect(PacketPtr message, std::size_t dataSize) {
 	memcpy(message->hash, MyHash_.str, hash_length);
 	memcpy(message->publicKey, MyPublicKey_.str, publicKey_length);
 
-	outSendPack(message, dataSize, nullptr);
+	if (shard.deferred)
+		io_service_client_.post([this, message, dataSize] { redirectPack(message, dataSize); });
+	else
+		redirectPack(message, dataSize);
 
 	return needProcessing;
 }
 
-inline uint32_t SessionIO::getBackDataCounter(PacketPtr message) {
-	Hash key{ message->HashBlock };
-	*((uint16_t*)(key.str)) = message->header;
+void SessionIO::redirectPack(PacketPtr message, std::size_t dataSize) {
+	const auto size_pck = dataSize + Packet::headerLength();
+	const bool block = (message->subcommand == SubCommandList::GetBlock || message->subcommand == SubCommandList::GetCompactBlock);
+	const auto cls = (block ? TrafficClass::Bulk : TrafficClass::Consensus);
+	m_gossip.select(m_nodesRing.getEndPoints(), [this, &message, size_pck, cls] (const udp::endpoint& ep) {
+		handleSend(message, size_pck, ep, cls);
+	});
+}
+
+inline uint32_t SessionIO::getBackDataCounter(ReceiveShard& shard, PacketPtr message) {
+	return shard.backData.pushAndIncrease(DedupFilter<50000>::fingerprint(message->HashBlock, message->header));
+}
+
+void SessionIO::noteSender(ReceiveShard& shard) {
+	if (!shard.deferred) {
+		addToRingBuffer(shard.sender.address());
+		return;
+	}
+
+	// The ring belongs to the main loop; repeated senders are not posted again
+	const auto addr = shard.sender.address();
+	if (addr == shard.lastSender) return;
+
+	shard.lastSender = addr;
+	io_service_client_.post([this, addr] { addToRingBuffer(addr); });
+}
+
+void SessionIO::sendAck(ReceiveShard& shard, const Packet& message, const PacketPart* part) {
+	PacketPtr ack = m_pacman.getFreePack(part ? sizeof(uint16_t) * (part->count + 1) : 0);
+	std::size_t size = 0;
+
+	if (part) {
+		uint16_t count = 0;
+		for (size_t i = 0; i < part->count; ++i) {
+			if (part->packets[i]) continue;
+
+			const uint16_t index = (uint16_t)i;
+			memcpy(ack->data + sizeof(uint16_t) * (count + 1), &index, sizeof(index));
+			++count;
+		}
 
-	return m_backData.pushAndIncrease(key);
+		memcpy(ack->data, &count, sizeof(count));
+		size = sizeof(uint16_t) * (count + 1);
+	}
+
+	ack->command = part ? CommandList::Nack : CommandList::Ack;
+	ack->subcommand = SubCommandList::Empty;
+	ack->version = Version::version_1;
+	ack->origin_ip = MyIp_.to_v4().to_uint();
+	memcpy(ack->hash, MyHash_.str, hash_length);
+	memcpy(ack->publicKey, MyPublicKey_.str, publicKey_length);
+	memcpy(ack->HashBlock, message.HashBlock, hash_length);
+	ack->header = 0;
+	ack->countHeader = 0;
+
+	const auto addr = ip::make_address_v4(message.origin_ip);
+	udp::endpoint ep(addr, addr == signalServerAddr ? signalServerPort : nodePort);
+	const auto sizePck = size + Packet::headerLength();
+
+	if (shard.deferred)
+		io_service_client_.post([this, ack, sizePck, ep] { handleSend(ack, sizePck, ep, TrafficClass::Consensus); });
+	else
+		handleSend(ack, sizePck, ep, TrafficClass::Consensus);
+}
+
+void SessionIO::handleAck(const Packet& ack, std::size_t size) {
+	std::vector<uint16_t> missing;
+	if (ack.command == CommandList::Nack) {
+		uint16_t count;
+		if (size < sizeof(count)) return;
+
+		memcpy(&count, ack.data, sizeof(count));
+		if (size < sizeof(uint16_t) * (count + 1)) return;
+
+		missing.resize(count);
+		memcpy(missing.data(), ack.data + sizeof(count), sizeof(uint16_t) * count);
+	}
+
+	const auto now = Clock::now();
+
+	std::lock_guard<std::mutex> lock(m_directLock);
+	auto range = m_directTasks.equal_range(ack.origin_ip);
+	for (auto it = range.first; it != range.second; ) {
+		bool matches = false;
+		const bool alive = m_taskman.update(it->second, [this, &ack, &missing, &matches, now] (Task& t) {
+			if (t.packets.empty() || memcmp(t.packets.front()->HashBlock, ack.HashBlock, hash_length) != 0)
+				return;
+
+			matches = true;
+
+			// Only the reply to a message sent once tells which copy it answers (Karn's
+			// algorithm). A Nack uses up the sample, the Ack after the resend answers either
+			if (t.launches == 1 && !t.sampled) {
+				m_peerRtt[ack.origin_ip].sample(now - t.firstLaunch);
+				m_networkRtt.sample(now - t.firstLaunch);
+				t.sampled = true;
+			}
+
+			if (ack.command == CommandList::Nack) {
+				t.missing.assign(t.packets.size(), false);
+				for (auto index : missing)
+					if (index < t.missing.size())
+						t.missing[index] = true;
+			}
+		});
+
+		if (!alive) {
+			it = m_directTasks.erase(it);
+			continue;
+		}
+
+		if (matches) {
+			if (ack.command == CommandList::Ack) {
+				m_taskman.remove(it->second);
+				m_directTasks.erase(it);
+			}
+			return;
+		}
+
+		++it;
+	}
 }
 
 void SessionIO::addToRingBuffer(const boost::asio::ip::address& addr) {
@@ -281,29 +631,83 @@ void SessionIO::addToRingBuffer(const boost::asio::ip::address& addr) {
 	if (addedNew) SendGreetings();
 }
 
-TaskId SessionIO::addTaskDirect(std::vector<PacketPtr>&& packets, const CommandList cmd, const SubCommandList subcmd, const size_t lastSize, const ip::address& ip) {
+TaskId SessionIO::addTaskDirect(std::vector<PacketPtr>&& packets, const CommandList cmd, const SubCommandList subcmd, const size_t lastSize, const ip::address& ip, const TrafficClass cls) {
 	createSendTasks(packets, cmd, subcmd, lastSize);
 	udp::endpoint regEndPoint(ip, ip == signalServerAddr ? signalServerPort : nodePort);
 
-	Task t(std::move(packets), lastSize, std::move(regEndPoint));
-	return m_taskman.add(std::move(t));
+	Task t(std::move(packets), lastSize, std::move(regEndPoint), cls);
+	TaskId result;
+
+	{
+		std::lock_guard<std::mutex> lock(m_directLock);
+
+		const auto addr = ip.to_v4().to_uint();
+		const auto rtt = m_peerRtt.find(addr);
+		t.timeout = (rtt != m_peerRtt.end() ? rtt->second : m_networkRtt).rto();
+
+		result = m_taskman.add(std::move(t));
+		m_directTasks.emplace(addr, result);
+	}
+
+	io_service_client_.dispatch([this] { scheduleTasks(); });
+	return result;
+}
+
+void SessionIO::removeAllTasks() {
+	m_taskman.clear();
+
+	std::lock_guard<std::mutex> lock(m_directLock);
+	m_directTasks.clear();
+}
+
+std::vector<std::pair<ip::address_v4, RttEstimator>> SessionIO::getPeerRtt() {
+	std::lock_guard<std::mutex> lock(m_directLock);
+
+	std::vector<std::pair<ip::address_v4, RttEstimator>> result;
+	result.reserve(m_peerRtt.size());
+	for (auto& peer : m_peerRtt)
+		result.emplace_back(ip::make_address_v4(peer.first), peer.second);
+	return result;
+}
+
+RttEstimator SessionIO::getNetworkRtt() {
+	std::lock_guard<std::mutex> lock(m_directLock);
+	return m_networkRtt;
 }
 
-TaskId SessionIO::addTaskBroadcast(std::vector<PacketPtr>&& packets, const SubCommandList subcmd, const size_t lastSize) {
+TaskId SessionIO::addTaskBroadcast(std::vector<PacketPtr>&& packets, const SubCommandList subcmd, const size_t lastSize, const TrafficClass cls) {
 	createSendTasks(packets, CommandList::Redirect, subcmd, lastSize);
 
-	Task t(std::move(packets), lastSize, m_nodesRing.getEndPoints());
-	return m_taskman.add(std::move(t));
+	const size_t count = packets.size();
+	if (fec_)
+		addParity(packets, lastSize);
+
+	Task t(std::move(packets), lastSize, m_nodesRing.getEndPoints(), cls);
+	if (count)
+		t.shortIndex = count - 1;
+
+	{
+		std::lock_guard<std::mutex> lock(m_directLock);
+		if (m_networkRtt.samples())
+			t.timeout = m_networkRtt.rto();
+	}
+	TaskId result = m_taskman.add(std::move(t));
+
+	io_service_client_.dispatch([this] { scheduleTasks(); });
+	return result;
 }
 
-inline void SessionIO::createSendTasks(const std::vector<PacketPtr>& packets, const CommandList cmd, const SubCommandList subcmd, const size_t lastSize) {
+inline void SessionIO::createSendTasks(std::vector<PacketPtr>& packets, const CommandList cmd, const SubCommandList subcmd, const size_t lastSize) {
 	if (packets.empty()) return;
 
 	outFrmPack(packets.front(), cmd, subcmd, Version::version_1, packets.size() == 1 ? lastSize : max_length);
 	packets.front()->header = 0;
 
-	if (packets.size() == 1)
+	// A single packet may sit in the task for a while, so it moves to one of its size
+	if (packets.size() == 1) {
 		packets.front()->countHeader = 0;
+		packets.front() = m_pacman.shrink(packets.front(), Packet::headerLength() + lastSize);
+	}
 	else {
 		packets.front()->countHeader = (uint16_t)packets.size();
 		for (size_t i = 1; i < packets.size(); ++i) {
@@ -313,6 +717,12 @@ inline void SessionIO::createSendTasks(const std::vector<PacketPtr>& packets, co
 	}
 }
 
+void SessionIO::addParity(std::vector<PacketPtr>& packets, const size_t lastSize) {
+	if (packets.size() + fecParityCount(packets.size()) > MAX_PART) return;
+
+	addFecParity(packets, lastSize, [this] (std::size_t dataSize) { return m_pacman.getFreePack(dataSize); });
+}
+
 inline void SessionIO::outFrmPack(const PacketPtr packet, const CommandList cmd, const SubCommandList sub_cmd, const Version ver, const size_t size_data) {
 	m_hasher.nextHash(packet->data, size_data, packet->HashBlock);
 	packet->origin_ip = MyIp_.to_v4().to_uint();
@@ -330,12 +740,77 @@ inline void SessionIO::outSendPack(PacketPtr message, std::size_t dataSize, cons
 
 	if (endpoint == nullptr)
 		for (auto& ep : m_nodesRing.getEndPoints())
-			handleSend(message, size_pck, ep);
+			handleSend(message, size_pck, ep, TrafficClass::Consensus);
 	else
-		handleSend(message, size_pck, *endpoint);
+		handleSend(message, size_pck, *endpoint, TrafficClass::Consensus);
+}
+
+inline void SessionIO::handleSend(PacketPtr message, std::size_t size_pck, const udp::endpoint& endpoint, const TrafficClass cls) {
+	if (coalesced(message, size_pck, endpoint)) {
+		auto alloc = [this] (std::size_t dataSize) { return m_pacman.getFreePack(dataSize); };
+		auto send = [this] (PacketPtr pack, std::size_t size, const udp::endpoint& ep, TrafficClass c) { queueSend(pack, size, ep, c); };
+		if (!m_coalescer.add(message, size_pck - Packet::headerLength(), endpoint, cls, alloc, send))
+			return;
+
+		// The first message of a window sets the time the whole window goes out
+		if (coalesceWindow_.count() == 0) {
+			io_service_client_.post([this] { flushCoalesced(); });
+			return;
+		}
+
+		m_coalesceTimer.expires_after(coalesceWindow_);
+		m_coalesceTimer.async_wait([this] (const boost::system::error_code& error) {
+			if (error != boost::asio::error::operation_aborted)
+				flushCoalesced();
+		});
+		return;
+	}
+
+	queueSend(message, size_pck, endpoint, cls);
+}
+
+// Only the direct messages of this node, which the main loop sends: the redirects keep the
+// header of their origin and the signal server reads no bundles
+bool SessionIO::coalesced(const PacketPtr& message, std::size_t size_pck, const udp::endpoint& endpoint) const {
+	return coalesce_ &&
+		message->countHeader == 0 &&
+		message->command != CommandList::Redirect &&
+		message->command != CommandList::Registration &&
+		endpoint.address() != signalServerAddr &&
+		MessageCoalescer::fits(size_pck - Packet::headerLength());
 }
 
-inline void SessionIO::handleSend(PacketPtr message, std::size_t size_pck, const udp::endpoint& endpoint) {
+void SessionIO::flushCoalesced() {
+	m_coalescer.flush([this] (PacketPtr pack, std::size_t size, const udp::endpoint& ep, TrafficClass cls) { queueSend(pack, size, ep, cls); });
+}
+
+void SessionIO::queueSend(PacketPtr message, std::size_t size_pck, const udp::endpoint& endpoint, const TrafficClass cls) {
+	bool post;
+	{
+		std::lock_guard<boost::detail::spinlock> lock(m_sendLock);
+		m_sendQueues.push(cls, QueuedSend{ message, size_pck, endpoint }, size_pck);
+		post = !m_flushPosted;
+		m_flushPosted = true;
+	}
+
+	// Everything queued by the handlers that run before it goes out in one batch.
+	// A flush waiting for the socket or the pacing may let the new message go first
+	if (post)
+		postFlush();
+}
+
+// With m_flushPosted set: at most one flush waits in the loop
+void SessionIO::postFlush() {
+	io_service_client_.post([this] {
+		{
+			std::lock_guard<boost::detail::spinlock> lock(m_sendLock);
+			m_flushPosted = false;
+		}
+		flushSends();
+	});
+}
+
+void SessionIO::sendPacketAsync(PacketPtr message, std::size_t size_pck, const udp::endpoint& endpoint) {
 	OutputServiceSocket_->async_send_to(boost::asio::buffer((char*)message.get(), size_pck),
 		endpoint,
 		boost::bind(&SessionIO::outputHandleSend, this, message,
@@ -350,22 +825,136 @@ void SessionIO::outputHandleSend(PacketPtr message, const boost::system::error_c
 	}
 }
 
-void SessionIO::senderThreadRoutine() {
+void SessionIO::launchTasks() {
 	m_taskman.run([this] (const Task& task) {
-		size_t cntr = 0;
-		for (auto& pack : task.packets) {
-			++cntr;
+		for (size_t i = 0; i < task.packets.size(); ++i) {
+			if (!task.missing.empty() && !task.missing[i]) continue;
+
+			const size_t size = ((i == task.shortIndex || i + 1 == task.packets.size()) ? task.lastSize : Packet::headerLength() + max_length);
 			for (auto& recv : task.receivers) {
-				handleSend(pack, (cntr == task.packets.size() ? task.lastSize : Packet::headerLength() + max_length), recv);
+				handleSend(task.packets[i], size, recv, task.trafficClass);
+			}
+		}
+	});
+
+	flushSends();
+}
+
+void SessionIO::scheduleTasks() {
+	if (m_taskman.empty()) return;
+
+	const auto next = m_taskman.nextTime();
+	if (m_taskTimerArmed && next >= m_taskDeadline) return;
+
+	m_taskTimerArmed = true;
+	m_taskDeadline = next;
+	m_taskTimer.expires_at(next);
+	m_taskTimer.async_wait([this] (const boost::system::error_code& error) {
+		if (error == boost::asio::error::operation_aborted) return;
+
+		m_taskTimerArmed = false;
+		launchTasks();
+		scheduleTasks();
+	});
+}
+
+void SessionIO::flushSends() {
+	const auto now = Clock::now();
+	{
+		std::lock_guard<boost::detail::spinlock> lock(m_sendLock);
+		m_sendQueues.pop(now, IO_BATCH_SIZE, [this] (QueuedSend&& qs) { m_sendBatch.push_back(std::move(qs)); });
+	}
+
+	size_t sent = 0;
+	bool blocked = false;
+
+#ifdef __linux__
+	mmsghdr msgs[IO_BATCH_SIZE];
+	iovec iovs[IO_BATCH_SIZE];
+
+	while (batchedIO_ && sent < m_sendBatch.size()) {
+		const size_t count = std::min<size_t>(IO_BATCH_SIZE, m_sendBatch.size() - sent);
+
+		memset(msgs, 0, sizeof(mmsghdr) * count);
+		for (size_t i = 0; i < count; ++i) {
+			QueuedSend& qs = m_sendBatch[sent + i];
+			iovs[i].iov_base = qs.packet.get();
+			iovs[i].iov_len = qs.size;
+			msgs[i].msg_hdr.msg_name = qs.endpoint.data();
+			msgs[i].msg_hdr.msg_namelen = qs.endpoint.size();
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		const int result = sendmmsg(OutputServiceSocket_->native_handle(), msgs, count, MSG_DONTWAIT);
+		if (result < 0) {
+			if (errno == ENOSYS) {
+				LOG_WARN("sendmmsg is not supported, switching to the per-packet I/O");
+				batchedIO_ = false;
 			}
+			else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				// The first message of the batch was rejected, the rest are retried
+				LOG_ERROR("Cannot send package: " << strerror(errno));
+				++sent;
+				continue;
+			}
+			else
+				blocked = true;
+			break;
 		}
+
+		for (int i = 0; i < result; ++i)
+			LOG_OUT_PACK(m_sendBatch[sent + i].packet, msgs[i].msg_len);
+		sent += result;
+	}
+#endif
+
+	// Whatever the kernel did not take goes through the asynchronous path
+	for (; sent < m_sendBatch.size(); ++sent) {
+		QueuedSend& qs = m_sendBatch[sent];
+		sendPacketAsync(qs.packet, qs.size, qs.endpoint);
+	}
+
+	m_sendBatch.clear();
+
+	Clock::time_point next;
+	{
+		std::lock_guard<boost::detail::spinlock> lock(m_sendLock);
+		if (m_sendQueues.empty() || m_flushPosted) return;
+
+		next = m_sendQueues.nextTime(now);
+		if (!blocked && next <= now)
+			m_flushPosted = true;
+	}
+
+	if (!blocked && next <= now) {
+		postFlush();
+		return;
+	}
+
+	// The rest waits while the socket buffer is full or the classes left are over their rates
+	if (blocked) {
+		if (m_writeWaiting) return;
+
+		m_writeWaiting = true;
+		OutputServiceSocket_->async_wait(udp::socket::wait_write, [this] (const boost::system::error_code&) {
+			m_writeWaiting = false;
+			flushSends();
+		});
+		return;
+	}
+
+	m_flushTimer.expires_at(next);
+	m_flushTimer.async_wait([this] (const boost::system::error_code& error) {
+		if (error != boost::asio::error::operation_aborted)
+			flushSends();
 	});
 }
 
 inline void SessionIO::RegistrationToServer() {
 	while (AwaitingRegistration) { 
 		std::string version = std::to_string(CURRENT_VERSION);
-		auto pack = m_pacman.getFreePack();
+		auto pack = m_pacman.getFreePack(version.size());
 		memcpy(pack->data, version.c_str(), version.size());
 		outFrmPack(pack, CommandList::Registration, SubCommandList::Empty, Version::version_1, version.size());
 		outSendPack(pack, version.size(), &OutputServiceServerEndpoint_);
@@ -412,9 +1001,25 @@ bool SessionIO::GenerationHash() {
 void SessionIO::Run() {
 	InitConnection();
 
-	while (true) {
-		io_service_client_.poll();
-		senderThreadRoutine();
+	boost::asio::io_service::work work(io_service_client_);
+	if (!measureWakeups_) {
+		io_service_client_.run();
+		return;
+	}
+
+	// Measurement mode: every handler run by the loop counts as a wakeup
+	uint64_t wakeups = 0;
+	auto since = Clock::now();
+	while (io_service_client_.run_one()) {
+		++wakeups;
+
+		const auto now = Clock::now();
+		if (now - since >= std::chrono::seconds(1)) {
+			const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - since).count();
+			LOG_NOTICE("Loop wakeups: " << (wakeups * 1000 / ms) << "/s");
+			wakeups = 0;
+			since = now;
+		}
 	}
 }
 
@@ -0,0 +1,143 @@
+#include "net/Structures.hpp"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+struct Sent {
+	PacketPtr packet;
+	size_t size;
+	udp::endpoint endpoint;
+	TrafficClass cls;
+};
+
+PacketPtr makeMessage(PacketManager<16>& manager, CommandList command, uint32_t id, size_t dataSize) {
+	PacketPtr result = manager.getFreePack(dataSize);
+	memset(result.get(), 0, Packet::headerLength());
+	result->command = command;
+	result->subcommand = SubCommandList::Empty;
+	result->origin_ip = 0x7f000001;
+	memcpy(result->HashBlock, &id, sizeof(id));
+	memset(result->data, (int)id, dataSize);
+	return result;
+}
+
+const udp::endpoint FIRST(ip::address_v4(0x7f000001), 9001);
+const udp::endpoint SECOND(ip::address_v4(0x7f000002), 9001);
+
+} // namespace
+
+class CoalescerTest : public ::testing::Test
+{
+protected:
+	PacketManager<16> manager;
+	MessageCoalescer coalescer;
+	std::vector<Sent> sent;
+
+	bool add(const PacketPtr& message, size_t dataSize, const udp::endpoint& ep, TrafficClass cls = TrafficClass::Bulk) {
+		return coalescer.add(message, dataSize, ep, cls,
+			[this] (size_t size) { return manager.getFreePack(size); },
+			[this] (PacketPtr pack, size_t size, const udp::endpoint& to, TrafficClass c) { sent.push_back(Sent{ pack, size, to, c }); });
+	}
+
+	void flush() {
+		coalescer.flush([this] (PacketPtr pack, size_t size, const udp::endpoint& to, TrafficClass c) { sent.push_back(Sent{ pack, size, to, c }); });
+	}
+
+	std::vector<PacketPtr> unbundle(const Sent& bundle) {
+		std::vector<PacketPtr> result;
+		EXPECT_TRUE(MessageCoalescer::unbundle(*bundle.packet.get(), bundle.size - Packet::headerLength(),
+			[this] (size_t size) { return manager.getFreePack(size); },
+			[&result] (PacketPtr message, size_t size) {
+				if (size) {
+					EXPECT_EQ(message->data[size - 1], message->HashBlock[0]);
+				}
+				result.push_back(message);
+			}));
+		return result;
+	}
+};
+
+TEST_F(CoalescerTest, LoneMessageGoesAsIs)
+{
+	PacketPtr message = makeMessage(manager, CommandList::SendHash, 1, 100);
+	EXPECT_TRUE(add(message, 100, FIRST));
+	EXPECT_TRUE(sent.empty());
+
+	flush();
+	ASSERT_EQ(sent.size(), 1u);
+	EXPECT_EQ(sent[0].packet.get(), message.get());
+	EXPECT_EQ(sent[0].size, Packet::headerLength() + 100);
+	EXPECT_TRUE(coalescer.empty());
+}
+
+TEST_F(CoalescerTest, BundlesPerPeer)
+{
+	EXPECT_TRUE(add(makeMessage(manager, CommandList::SendHash, 1, 100), 100, FIRST));
+	EXPECT_FALSE(add(makeMessage(manager, CommandList::SendTransaction, 2, 300), 300, SECOND));
+	EXPECT_FALSE(add(makeMessage(manager, CommandList::Ack, 3, 0), 0, FIRST, TrafficClass::Consensus));
+	EXPECT_FALSE(add(makeMessage(manager, CommandList::SendVector, 4, 200), 200, FIRST));
+	EXPECT_TRUE(sent.empty());
+
+	flush();
+	ASSERT_EQ(sent.size(), 2u);
+	const Sent& bundle = sent[0].endpoint == FIRST ? sent[0] : sent[1];
+	const Sent& single = sent[0].endpoint == FIRST ? sent[1] : sent[0];
+
+	EXPECT_EQ(single.packet->command, CommandList::SendTransaction);
+	EXPECT_EQ(bundle.packet->command, CommandList::Bundle);
+	EXPECT_EQ(bundle.cls, TrafficClass::Consensus);
+	EXPECT_EQ(single.cls, TrafficClass::Bulk);
+	EXPECT_EQ(bundle.size, Packet::headerLength() + 3 * sizeof(BundleEntry) + 300);
+
+	auto messages = unbundle(bundle);
+	ASSERT_EQ(messages.size(), 3u);
+	EXPECT_EQ(messages[0]->command, CommandList::SendHash);
+	EXPECT_EQ(messages[1]->command, CommandList::Ack);
+	EXPECT_EQ(messages[2]->command, CommandList::SendVector);
+	const char ids[] = { 1, 3, 4 };
+	for (size_t i = 0; i < messages.size(); ++i) {
+		EXPECT_EQ(messages[i]->HashBlock[0], ids[i]);
+		EXPECT_EQ(messages[i]->origin_ip, 0x7f000001u);
+		EXPECT_EQ(messages[i]->countHeader, 0);
+	}
+}
+
+TEST_F(CoalescerTest, FullBundleGoesEarly)
+{
+	const size_t dataSize = 8000;
+	const size_t perBundle = max_length / (sizeof(BundleEntry) + dataSize);
+
+	for (uint32_t i = 0; i < perBundle + 1; ++i)
+		add(makeMessage(manager, CommandList::SendMatrix, i + 1, dataSize), dataSize, FIRST);
+
+	ASSERT_EQ(sent.size(), 1u);
+	EXPECT_EQ(unbundle(sent[0]).size(), perBundle);
+	EXPECT_LE(sent[0].size, sizeof(Packet));
+
+	flush();
+	ASSERT_EQ(sent.size(), 2u);
+	EXPECT_EQ(sent[1].packet->command, CommandList::SendMatrix);
+}
+
+TEST_F(CoalescerTest, MalformedBundle)
+{
+	add(makeMessage(manager, CommandList::SendHash, 1, 100), 100, FIRST);
+	add(makeMessage(manager, CommandList::SendHash, 2, 100), 100, FIRST);
+	flush();
+	ASSERT_EQ(sent.size(), 1u);
+
+	size_t count = 0;
+	auto alloc = [this] (size_t size) { return manager.getFreePack(size); };
+	auto counter = [&count] (PacketPtr, size_t) { ++count; };
+	const size_t dataSize = sent[0].size - Packet::headerLength();
+
+	EXPECT_FALSE(MessageCoalescer::unbundle(*sent[0].packet.get(), dataSize - 1, alloc, counter));
+	EXPECT_EQ(count, 1u);
+
+	count = 0;
+	EXPECT_FALSE(MessageCoalescer::unbundle(*sent[0].packet.get(), sizeof(BundleEntry) - 1, alloc, counter));
+	EXPECT_EQ(count, 0u);
+}
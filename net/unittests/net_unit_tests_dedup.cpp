@@ -0,0 +1,89 @@
+#include "net/Structures.hpp"
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+Hash makeHashBlock(uint32_t number) {
+	Hash result;
+	memset(result.str, 0, hash_length);
+	memcpy(result.str + hash_length - sizeof(number), &number, sizeof(number));
+	return result;
+}
+
+} // namespace
+
+class DedupFilterTest : public ::testing::Test
+{
+};
+
+TEST_F(DedupFilterTest, Fingerprint)
+{
+	const Hash first = makeHashBlock(1);
+	const Hash second = makeHashBlock(2);
+
+	EXPECT_EQ(DedupFilter<16>::fingerprint(first.str, 0), DedupFilter<16>::fingerprint(first.str, 0));
+	EXPECT_NE(DedupFilter<16>::fingerprint(first.str, 0), DedupFilter<16>::fingerprint(first.str, 1));
+	EXPECT_NE(DedupFilter<16>::fingerprint(first.str, 0), DedupFilter<16>::fingerprint(second.str, 0));
+	EXPECT_NE(DedupFilter<16>::fingerprint(first.str, 0), 0u);
+}
+
+TEST_F(DedupFilterTest, CountsCopies)
+{
+	DedupFilter<1000> filter;
+
+	for (uint32_t i = 0; i < 1000; ++i)
+		EXPECT_EQ(filter.pushAndIncrease(DedupFilter<1000>::fingerprint(makeHashBlock(i).str, 0)), 1u);
+
+	for (uint32_t i = 0; i < 1000; ++i) {
+		const auto fingerprint = DedupFilter<1000>::fingerprint(makeHashBlock(i).str, 0);
+		EXPECT_EQ(filter.pushAndIncrease(fingerprint), 2u);
+		EXPECT_EQ(filter.pushAndIncrease(fingerprint), 3u);
+	}
+
+	filter.clear();
+	EXPECT_EQ(filter.pushAndIncrease(DedupFilter<1000>::fingerprint(makeHashBlock(0).str, 0)), 1u);
+}
+
+TEST_F(DedupFilterTest, ForgetsOldestWhenFull)
+{
+	DedupFilter<1000> filter;
+
+	const uint32_t total = 100000;
+	for (uint32_t i = 0; i < total; ++i)
+		filter.pushAndIncrease(DedupFilter<1000>::fingerprint(makeHashBlock(i).str, 0));
+
+	size_t forgotten = 0;
+	for (uint32_t i = 0; i < total - 1000; ++i)
+		forgotten += filter.pushAndIncrease(DedupFilter<1000>::fingerprint(makeHashBlock(i).str, 0)) == 1;
+
+	EXPECT_GE(forgotten, (total - 1000) * 99 / 100);
+}
+
+TEST_F(DedupFilterTest, RemembersRecent)
+{
+	DedupFilter<1000> filter;
+
+	for (uint32_t i = 0; i < 100000; ++i) {
+		filter.pushAndIncrease(DedupFilter<1000>::fingerprint(makeHashBlock(i).str, 0));
+
+		// The copy of a fragment received a short while ago
+		if (i >= 100) {
+			EXPECT_EQ(filter.pushAndIncrease(DedupFilter<1000>::fingerprint(makeHashBlock(i - 100).str, 0)), 2u);
+		}
+	}
+}
+
+TEST_F(DedupFilterTest, TimeWindow)
+{
+	DedupFilter<1000> filter(std::chrono::milliseconds(20));
+	const auto fingerprint = DedupFilter<1000>::fingerprint(makeHashBlock(1).str, 0);
+
+	EXPECT_EQ(filter.pushAndIncrease(fingerprint), 1u);
+	EXPECT_EQ(filter.pushAndIncrease(fingerprint), 2u);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	EXPECT_EQ(filter.pushAndIncrease(fingerprint), 1u);
+}
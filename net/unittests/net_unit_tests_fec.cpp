@@ -0,0 +1,224 @@
+#include "net/Structures.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+const size_t LAST_SIZE = 300;
+const size_t MAX_PARTS = 2048;
+
+// Message lengths around the group size, including short last groups
+const size_t COUNTS[] = { 2, 3, 8, 9, 10, 16, 17, 20 };
+
+} // namespace
+
+class FecTest : public ::testing::Test
+{
+protected:
+	PacketManager<64> manager;
+	std::mt19937 random{ 42 };
+
+	// The data fragments of a message followed by its parity, as SessionIO sends them
+	std::vector<PacketPtr> makeMessage(size_t count) {
+		std::vector<PacketPtr> result;
+		for (size_t i = 0; i < count; ++i) {
+			PacketPtr pack = manager.getFreePack();
+			for (size_t j = 0; j < sizeof(Packet); ++j)
+				reinterpret_cast<char*>(pack.get())[j] = (char)random();
+
+			if (i)
+				memcpy(pack.get(), result.front().get(), Packet::headerLength());
+			pack->header = (uint16_t)i;
+			pack->countHeader = (uint16_t)count;
+			result.push_back(pack);
+		}
+
+		addFecParity(result, LAST_SIZE, [this] (size_t dataSize) { return manager.getFreePack(dataSize); });
+		return result;
+	}
+
+	static size_t dataSize(const std::vector<PacketPtr>& message, size_t index) {
+		const size_t count = message.front()->countHeader;
+		return (index == count - 1 || index == message.size() - 1) ? LAST_SIZE : (size_t)max_length;
+	}
+
+	// Feeds the fragments in the given order, returns the collected message
+	PacketPart collect(const std::vector<PacketPtr>& message, const std::vector<size_t>& order, size_t maxSize = MAX_PARTS) {
+		PacketPart part(message.front()->countHeader, maxSize);
+		for (auto index : order)
+			part.tryInsert(message[index], dataSize(message, index), [this] { return manager.getFreePack(); });
+
+		return part;
+	}
+
+	// Checks the collected data fragments byte for byte against the sent ones
+	static void expectComplete(const std::vector<PacketPtr>& message, const PacketPart& part) {
+		const size_t count = part.count;
+		ASSERT_EQ(part.left, 0u);
+		EXPECT_EQ(part.totalSize, (count - 1) * max_length + LAST_SIZE);
+
+		for (size_t i = 0; i < count; ++i) {
+			ASSERT_TRUE(part.packets[i]);
+			EXPECT_EQ(memcmp(part.packets[i]->data, message[i]->data, dataSize(message, i)), 0) << "fragment " << i << " of " << count;
+			EXPECT_EQ(headerOf(part.packets[i]), headerOf(message[i])) << "fragment " << i << " of " << count;
+
+			// The last fragment may be the copy, which keeps its own index
+			if (i + 1 < count) {
+				EXPECT_EQ(part.packets[i]->header, i);
+			}
+		}
+	}
+
+	// The packet header without the fragment index
+	static std::vector<char> headerOf(const PacketPtr& pack) {
+		std::vector<char> result(reinterpret_cast<const char*>(pack.get()), reinterpret_cast<const char*>(pack.get()) + Packet::headerLength());
+		memset(result.data() + offsetof(Packet, header), 0, sizeof(pack->header));
+		return result;
+	}
+
+	static std::vector<size_t> without(size_t size, size_t dropped) {
+		std::vector<size_t> result;
+		for (size_t i = 0; i < size; ++i)
+			if (i != dropped)
+				result.push_back(i);
+
+		return result;
+	}
+};
+
+TEST_F(FecTest, ParityLayout)
+{
+	for (size_t count : COUNTS) {
+		const auto message = makeMessage(count);
+		ASSERT_EQ(message.size(), count + fecParityCount(count));
+
+		for (size_t i = 0; i < message.size(); ++i) {
+			EXPECT_EQ(message[i]->header, i);
+			EXPECT_EQ(message[i]->countHeader, count);
+		}
+
+		// Each group parity is the XOR of its full fragments
+		size_t parity = count;
+		for (size_t begin = 0; begin < count - 1; begin += FEC_GROUP_SIZE, ++parity) {
+			std::vector<char> expected(max_length, 0);
+			for (size_t i = begin; i < std::min(begin + FEC_GROUP_SIZE, count - 1); ++i)
+				xorFragment(expected.data(), message[i]->data, max_length);
+
+			EXPECT_EQ(memcmp(message[parity]->data, expected.data(), max_length), 0) << "group " << begin / FEC_GROUP_SIZE << " of " << count;
+		}
+
+		// The last slot holds a copy of the last fragment
+		EXPECT_EQ(parity, message.size() - 1);
+		EXPECT_EQ(memcmp(message[parity]->data, message[count - 1]->data, LAST_SIZE), 0);
+	}
+}
+
+TEST_F(FecTest, SingleFragmentHasNoParity)
+{
+	std::vector<PacketPtr> message(1, manager.getFreePack());
+	addFecParity(message, LAST_SIZE, [this] (size_t dataSize) { return manager.getFreePack(dataSize); });
+	EXPECT_EQ(message.size(), 1u);
+}
+
+TEST_F(FecTest, RebuildParityAfterGap)
+{
+	for (size_t count : COUNTS) {
+		const auto message = makeMessage(count);
+		for (size_t dropped = 0; dropped < count; ++dropped)
+			expectComplete(message, collect(message, without(message.size(), dropped)));
+	}
+}
+
+TEST_F(FecTest, RebuildParityBeforeGap)
+{
+	for (size_t count : COUNTS) {
+		const auto message = makeMessage(count);
+		for (size_t dropped = 0; dropped < count; ++dropped) {
+			// The parity fragments first, then the data
+			std::vector<size_t> order;
+			for (size_t i = count; i < message.size(); ++i)
+				order.push_back(i);
+			for (size_t i = 0; i < count; ++i)
+				if (i != dropped)
+					order.push_back(i);
+
+			expectComplete(message, collect(message, order));
+		}
+	}
+}
+
+TEST_F(FecTest, RebuildShuffled)
+{
+	for (size_t count : COUNTS) {
+		const auto message = makeMessage(count);
+		for (size_t dropped = 0; dropped < count; ++dropped) {
+			auto order = without(message.size(), dropped);
+			std::shuffle(order.begin(), order.end(), random);
+			expectComplete(message, collect(message, order));
+		}
+	}
+}
+
+TEST_F(FecTest, RebuildOnePerGroup)
+{
+	const size_t count = 20;
+	const auto message = makeMessage(count);
+
+	// Fragments 3 and 10 are in different groups, the last one comes from its copy
+	std::vector<size_t> order;
+	for (size_t i = 0; i < message.size(); ++i)
+		if (i != 3 && i != 10 && i != count - 1)
+			order.push_back(i);
+
+	expectComplete(message, collect(message, order));
+}
+
+TEST_F(FecTest, TwoLostInGroupWaitForRetransmit)
+{
+	const size_t count = 10;
+	const auto message = makeMessage(count);
+
+	std::vector<size_t> order;
+	for (size_t i = 0; i < message.size(); ++i)
+		if (i != 2 && i != 5)
+			order.push_back(i);
+
+	PacketPart part = collect(message, order);
+	EXPECT_EQ(part.left, 2u);
+	EXPECT_FALSE(part.packets[2]);
+	EXPECT_FALSE(part.packets[5]);
+
+	// One of them is sent again, the parity rebuilds the other
+	EXPECT_TRUE(part.tryInsert(message[5], max_length, [this] { return manager.getFreePack(); }));
+	expectComplete(message, part);
+}
+
+TEST_F(FecTest, ParityOutOfRangeIsIgnored)
+{
+	const size_t count = 10;
+	const auto message = makeMessage(count);
+
+	// The whole sequence does not fit, so the collector keeps the data fragments only
+	PacketPart part = collect(message, without(message.size(), 4), count + 1);
+	EXPECT_EQ(part.size, count);
+	EXPECT_EQ(part.left, 1u);
+	EXPECT_FALSE(part.packets[4]);
+}
+
+TEST_F(FecTest, DuplicatesAfterRebuild)
+{
+	const size_t count = 9;
+	const auto message = makeMessage(count);
+
+	PacketPart part = collect(message, without(message.size(), 0));
+	expectComplete(message, part);
+
+	// The fragment that was rebuilt comes late
+	EXPECT_FALSE(part.tryInsert(message[0], max_length, [this] { return manager.getFreePack(); }));
+	expectComplete(message, part);
+}
@@ -0,0 +1,143 @@
+#include "net/Structures.hpp"
+
+#include <iostream>
+#include <memory>
+#include <set>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+const size_t NODES_COUNT = 64;
+const size_t MESSAGES_COUNT = 20;
+
+// A node of the loopback network: redirects every message once, on its first copy,
+// like SessionIO::RunRedirect with MAX_REDIRECT = 1
+struct LoopbackNode {
+	LoopbackNode(io_context& io, size_t index, size_t fanout) :
+		socket(io, udp::endpoint(ip::address_v4::loopback(), 0)),
+		gossip(fanout, (uint32_t)index) { }
+
+	udp::socket socket;
+	udp::endpoint sender;
+	uint64_t buffer;
+
+	GossipSelector gossip;
+	std::vector<udp::endpoint> peers;
+	std::set<uint64_t> seen;
+};
+
+struct LoopbackStats {
+	size_t sent = 0;
+	size_t covered = 0;
+};
+
+class LoopbackNetwork {
+public:
+	explicit LoopbackNetwork(size_t fanout) {
+		for (size_t i = 0; i < NODES_COUNT; ++i)
+			nodes_.emplace_back(new LoopbackNode(io_, i, fanout));
+
+		for (auto& node : nodes_) {
+			for (auto& other : nodes_)
+				if (other != node)
+					node->peers.push_back(other->socket.local_endpoint());
+
+			receive(*node);
+		}
+	}
+
+	LoopbackStats broadcast(uint64_t message) {
+		stats_ = LoopbackStats();
+		redirect(*nodes_.front(), message);
+
+		// The network is quiet once no datagram arrives for a while
+		while (io_.run_one_for(std::chrono::milliseconds(20)));
+		io_.restart();
+
+		for (auto& node : nodes_)
+			stats_.covered += node->seen.count(message);
+		return stats_;
+	}
+
+private:
+	void receive(LoopbackNode& node) {
+		node.socket.async_receive_from(buffer(&node.buffer, sizeof(node.buffer)), node.sender,
+			[this, &node] (const boost::system::error_code& error, std::size_t) {
+				if (!error)
+					redirect(node, node.buffer);
+				receive(node);
+			});
+	}
+
+	void redirect(LoopbackNode& node, uint64_t message) {
+		if (!node.seen.insert(message).second) return;
+
+		node.gossip.select(node.peers, [this, &node, message] (const udp::endpoint& ep) {
+			node.socket.send_to(buffer(&message, sizeof(message)), ep);
+			++stats_.sent;
+		});
+	}
+
+	io_context io_;
+	std::vector<std::unique_ptr<LoopbackNode>> nodes_;
+	LoopbackStats stats_;
+};
+
+} // namespace
+
+class GossipTest : public ::testing::Test
+{
+};
+
+TEST_F(GossipTest, Fanout)
+{
+	EXPECT_EQ(GossipSelector(0).fanout(500), 500u);
+	EXPECT_EQ(GossipSelector(5).fanout(500), 5u);
+	EXPECT_EQ(GossipSelector(5).fanout(3), 3u);
+	EXPECT_EQ(GossipSelector(GossipSelector::AUTO_FANOUT).fanout(500), 10u);
+	EXPECT_EQ(GossipSelector(GossipSelector::AUTO_FANOUT).fanout(64), 7u);
+	EXPECT_EQ(GossipSelector(GossipSelector::AUTO_FANOUT).fanout(1), 1u);
+	EXPECT_EQ(GossipSelector(GossipSelector::AUTO_FANOUT).fanout(0), 0u);
+}
+
+TEST_F(GossipTest, SelectsDistinctPeers)
+{
+	std::vector<int> peers;
+	for (int i = 0; i < 100; ++i) peers.push_back(i);
+
+	GossipSelector gossip(10, 1);
+	for (int round = 0; round < 100; ++round) {
+		std::set<int> selected;
+		gossip.select(peers, [&selected] (int peer) { EXPECT_TRUE(selected.insert(peer).second); });
+		EXPECT_EQ(selected.size(), 10u);
+	}
+}
+
+TEST_F(GossipTest, LoopbackCoverage)
+{
+	LoopbackNetwork flooding(0);
+	LoopbackNetwork gossip(GossipSelector::AUTO_FANOUT);
+
+	size_t floodingSent = 0, floodingCovered = 0;
+	size_t gossipSent = 0, gossipCovered = 0;
+	for (uint64_t message = 1; message <= MESSAGES_COUNT; ++message) {
+		const auto f = flooding.broadcast(message);
+		const auto g = gossip.broadcast(message);
+
+		EXPECT_EQ(f.covered, NODES_COUNT);
+		floodingSent += f.sent;
+		floodingCovered += f.covered;
+		gossipSent += g.sent;
+		gossipCovered += g.covered;
+	}
+
+	const double floodingCoverage = double(floodingCovered) / (NODES_COUNT * MESSAGES_COUNT);
+	const double gossipCoverage = double(gossipCovered) / (NODES_COUNT * MESSAGES_COUNT);
+	std::cout << "Flooding: " << floodingSent / MESSAGES_COUNT << " messages per broadcast, coverage " << floodingCoverage << std::endl;
+	std::cout << "Gossip:   " << gossipSent / MESSAGES_COUNT << " messages per broadcast, coverage " << gossipCoverage << std::endl;
+
+	EXPECT_EQ(floodingSent, NODES_COUNT * (NODES_COUNT - 1) * MESSAGES_COUNT);
+	EXPECT_GE(gossipCoverage, 0.98);
+	EXPECT_LT(gossipSent * 4, floodingSent);
+}
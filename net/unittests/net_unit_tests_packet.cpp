@@ -0,0 +1,136 @@
+#include "net/Structures.hpp"
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+PacketPtr makeFragment(PacketManager<16>& manager, uint32_t message, uint16_t index, uint16_t count) {
+	PacketPtr result = manager.getFreePack();
+	memset(result.get(), 0, Packet::headerLength());
+	memcpy(result->HashBlock, &message, sizeof(message));
+	result->header = index;
+	result->countHeader = count;
+	memset(result->data, index, max_length);
+	return result;
+}
+
+} // namespace
+
+class PacketTest : public ::testing::Test
+{
+};
+
+TEST_F(PacketTest, SizeClasses)
+{
+	EXPECT_EQ(packetSizeClass(0), 0u);
+	EXPECT_EQ(packetSizeClass(PACKET_CAPACITIES[0]), 0u);
+	EXPECT_EQ(packetSizeClass(PACKET_CAPACITIES[0] + 1), 1u);
+	EXPECT_EQ(packetSizeClass(max_length), PACKET_SIZE_CLASSES - 1);
+}
+
+TEST_F(PacketTest, Shrink)
+{
+	PacketManager<16> manager;
+
+	PacketPtr full = manager.getFreePack();
+	memset(full.get(), 7, Packet::headerLength() + 100);
+
+	PacketPtr small = manager.shrink(full, Packet::headerLength() + 100);
+	EXPECT_NE(small.get(), full.get());
+	EXPECT_EQ(memcmp(small.get(), full.get(), Packet::headerLength() + 100), 0);
+
+	// Already as small as it gets
+	EXPECT_EQ(manager.shrink(small, Packet::headerLength() + 10).get(), small.get());
+	EXPECT_EQ(manager.shrink(full, sizeof(Packet)).get(), full.get());
+}
+
+TEST_F(PacketTest, ReusesFreedPackets)
+{
+	PacketManager<16> manager;
+
+	Packet* first;
+	{
+		PacketPtr pack = manager.getFreePack(10);
+		first = pack.get();
+	}
+
+	PacketPtr again = manager.getFreePack(10);
+	EXPECT_EQ(again.get(), first);
+
+	// Every size class has its own packets
+	std::vector<PacketPtr> packs;
+	for (size_t i = 0; i < 100; ++i) {
+		packs.push_back(manager.getFreePack(i % 2 ? PACKET_CAPACITIES[0] : (size_t)max_length));
+		packs.back()->data[i % 2 ? PACKET_CAPACITIES[0] - 1 : (size_t)max_length - 1] = 1;
+	}
+}
+
+TEST_F(PacketTest, ThreadsShareThePool)
+{
+	const size_t THREADS_COUNT = 4;
+	const size_t ROUNDS_COUNT = 2000;
+
+	PacketManager<16> manager;
+	std::mutex lock;
+	std::vector<PacketPtr> handedOver;
+	std::atomic<size_t> failures{ 0 };
+
+	// Every thread owns its packets for a while, checks nobody else wrote to them and hands
+	// a part of them over to be released by another thread
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < THREADS_COUNT; ++t) {
+		threads.emplace_back([&, t] {
+			std::vector<PacketPtr> owned;
+			for (size_t round = 0; round < ROUNDS_COUNT; ++round) {
+				for (size_t i = 0; i < 8; ++i) {
+					owned.push_back(manager.getFreePack(i % 2 ? 10 : max_length));
+					owned.back()->origin_ip = (uint32_t)t;
+				}
+
+				std::this_thread::yield();
+				for (auto& pack : owned)
+					failures += (pack->origin_ip != t);
+
+				std::lock_guard<std::mutex> guard(lock);
+				for (size_t i = 0; i < owned.size(); i += 2)
+					handedOver.push_back(std::move(owned[i]));
+				if (handedOver.size() > 64)
+					handedOver.erase(handedOver.begin(), handedOver.begin() + 32);
+				owned.clear();
+			}
+		});
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+
+	EXPECT_EQ(failures, 0u);
+}
+
+TEST_F(PacketTest, CollectorDropsLateCopies)
+{
+	PacketManager<16> manager;
+	PacketCollector<Hash, 4, 16> collector;
+	auto alloc = [&manager] { return manager.getFreePack(); };
+
+	const uint16_t count = 3;
+	std::pair<PacketPart*, bool> result;
+	for (uint16_t i = 0; i < count; ++i) {
+		result = collector.append(makeFragment(manager, 1, i, count), max_length, alloc);
+		EXPECT_TRUE(result.second);
+	}
+
+	ASSERT_EQ(result.first->left, 0u);
+	for (uint16_t i = 0; i < count; ++i)
+		EXPECT_EQ(result.first->packets[i]->data[0], (char)i);
+
+	// The fragments of a delivered message are released
+	result.first->clear();
+	for (uint16_t i = 0; i < count; ++i) {
+		result = collector.append(makeFragment(manager, 1, i, count), max_length, alloc);
+		EXPECT_FALSE(result.second);
+		EXPECT_FALSE(result.first->packets[i]);
+	}
+}
@@ -0,0 +1,93 @@
+#include "net/Structures.hpp"
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+class RttTest : public ::testing::Test
+{
+};
+
+TEST_F(RttTest, InitialTimeout)
+{
+	RttEstimator rtt;
+	EXPECT_EQ(rtt.samples(), 0u);
+	EXPECT_EQ(rtt.rto(), DIRECT_INIT_TIMEOUT);
+}
+
+TEST_F(RttTest, FirstSample)
+{
+	RttEstimator rtt;
+	rtt.sample(milliseconds(100));
+
+	EXPECT_EQ(rtt.srtt(), milliseconds(100));
+	EXPECT_EQ(rtt.rttvar(), milliseconds(50));
+	EXPECT_EQ(rtt.rto(), milliseconds(300));
+}
+
+TEST_F(RttTest, JacobsonKarels)
+{
+	RttEstimator rtt;
+	rtt.sample(microseconds(8000));
+	rtt.sample(microseconds(16000));
+
+	// RTTVAR = 3/4 * 4000 + 1/4 * |8000 - 16000|, SRTT = 7/8 * 8000 + 1/8 * 16000
+	EXPECT_EQ(rtt.rttvar(), microseconds(5000));
+	EXPECT_EQ(rtt.srtt(), microseconds(9000));
+	EXPECT_EQ(rtt.rto(), microseconds(29000));
+}
+
+TEST_F(RttTest, SteadyPathConverges)
+{
+	RttEstimator rtt;
+	rtt.sample(milliseconds(200));
+	for (int i = 0; i < 100; ++i)
+		rtt.sample(milliseconds(20));
+
+	EXPECT_LT(rtt.srtt(), microseconds(20100));
+	EXPECT_LT(rtt.rto(), milliseconds(21));
+}
+
+TEST_F(RttTest, Bounds)
+{
+	RttEstimator lan;
+	for (int i = 0; i < 10; ++i)
+		lan.sample(microseconds(50));
+	EXPECT_EQ(lan.rto(), MIN_TIMEOUT);
+
+	RttEstimator slow;
+	slow.sample(std::chrono::seconds(3));
+	EXPECT_EQ(slow.rto(), MAX_TIMEOUT);
+}
+
+TEST_F(RttTest, TaskBackoff)
+{
+	TaskManager taskman;
+
+	Task fast(std::vector<PacketPtr>(), 0, udp::endpoint());
+	fast.timeout = microseconds(100);
+	const TaskId fastId = taskman.add(std::move(fast));
+
+	Task slow(std::vector<PacketPtr>(), 0, udp::endpoint());
+	slow.timeout = milliseconds(600);
+	const TaskId slowId = taskman.add(std::move(slow));
+
+	std::vector<microseconds> timeouts;
+	for (int i = 0; i < 4; ++i) {
+		std::this_thread::sleep_until(taskman.nextTime());
+		taskman.run([] (const Task&) { });
+		taskman.update(fastId, [&timeouts] (Task& task) { timeouts.push_back(task.timeout); });
+	}
+
+	EXPECT_EQ(timeouts, (std::vector<microseconds>{ microseconds(200), microseconds(400), microseconds(800), microseconds(1600) }));
+
+	// The slow task was launched once, right away, and stays at the limit
+	taskman.update(slowId, [] (Task& task) {
+		EXPECT_EQ(task.launches, 1u);
+		EXPECT_NE(task.firstLaunch, Clock::time_point());
+		EXPECT_EQ(task.timeout, MAX_TIMEOUT);
+	});
+}
@@ -0,0 +1,111 @@
+#include "net/Structures.hpp"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+const size_t ITEM_SIZE = 1000;
+
+struct Item {
+	TrafficClass cls;
+	size_t index;
+};
+
+} // namespace
+
+class SchedulerTest : public ::testing::Test
+{
+protected:
+	SendScheduler<Item> scheduler;
+
+	void push(TrafficClass cls, size_t count, size_t size = ITEM_SIZE) {
+		for (size_t i = 0; i < count; ++i)
+			scheduler.push(cls, Item{ cls, i }, size);
+	}
+
+	std::vector<Item> pop(size_t count, Clock::time_point now = Clock::now()) {
+		std::vector<Item> result;
+		scheduler.pop(now, count, [&result] (Item&& item) { result.push_back(item); });
+		return result;
+	}
+
+	static size_t countOf(const std::vector<Item>& items, TrafficClass cls) {
+		size_t result = 0;
+		for (auto& item : items)
+			result += (item.cls == cls);
+		return result;
+	}
+};
+
+TEST_F(SchedulerTest, SharesByWeight)
+{
+	push(TrafficClass::Consensus, 1000);
+	push(TrafficClass::Transactions, 1000);
+	push(TrafficClass::Bulk, 1000);
+
+	const auto items = pop(130);
+	ASSERT_EQ(items.size(), 130u);
+	EXPECT_EQ(countOf(items, TrafficClass::Consensus), 80u);
+	EXPECT_EQ(countOf(items, TrafficClass::Transactions), 40u);
+	EXPECT_EQ(countOf(items, TrafficClass::Bulk), 10u);
+}
+
+TEST_F(SchedulerTest, KeepsOrderWithinClass)
+{
+	push(TrafficClass::Bulk, 100);
+	push(TrafficClass::Consensus, 100);
+
+	size_t next[TRAFFIC_CLASSES] = {};
+	for (auto& item : pop(200))
+		EXPECT_EQ(item.index, next[(size_t)item.cls]++);
+	EXPECT_TRUE(scheduler.empty());
+}
+
+TEST_F(SchedulerTest, UrgentMessageOvertakesBacklog)
+{
+	push(TrafficClass::Bulk, 10000);
+	pop(5000);
+
+	// The consensus class has been idle and starts at the current virtual time, not at zero:
+	// it goes first, but does not starve the backlog
+	push(TrafficClass::Consensus, 1);
+	auto items = pop(1);
+	ASSERT_EQ(items.size(), 1u);
+	EXPECT_EQ(items[0].cls, TrafficClass::Consensus);
+
+	push(TrafficClass::Consensus, 1000);
+	items = pop(90);
+	EXPECT_EQ(countOf(items, TrafficClass::Consensus), 80u);
+	EXPECT_EQ(countOf(items, TrafficClass::Bulk), 10u);
+}
+
+TEST_F(SchedulerTest, PacesClass)
+{
+	const size_t rate = 100000;
+	const size_t size = 10000;
+	scheduler.setRate(TrafficClass::Bulk, rate);
+
+	const auto start = Clock::now();
+	push(TrafficClass::Bulk, 100, size);
+	push(TrafficClass::Consensus, 10);
+
+	// The burst allowance lets a full datagram and then some through
+	auto items = pop(100, start);
+	const size_t burst = (sizeof(Packet) + size - 1) / size;
+	EXPECT_EQ(countOf(items, TrafficClass::Bulk), burst);
+	EXPECT_EQ(countOf(items, TrafficClass::Consensus), 10u);
+	EXPECT_FALSE(scheduler.empty());
+
+	const auto next = scheduler.nextTime(start);
+	EXPECT_GT(next, start);
+	EXPECT_LE(next, start + std::chrono::milliseconds(100));
+	EXPECT_TRUE(pop(100, start).empty());
+
+	items = pop(100, next);
+	EXPECT_EQ(items.size(), 1u);
+
+	items = pop(100, start + std::chrono::seconds(10));
+	EXPECT_EQ(items.size(), burst);
+}
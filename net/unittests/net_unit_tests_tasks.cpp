@@ -0,0 +1,171 @@
+#include "net/Structures.hpp"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using std::chrono::milliseconds;
+
+class TaskManagerTest : public ::testing::Test
+{
+protected:
+	TaskManager taskman;
+	std::vector<int> fired;
+	const Clock::time_point start = Clock::now();
+
+	// A timer that is due right away, ordered by its offset into the past
+	TaskId addTimer(int name, int ageMs) {
+		return taskman.addTimer(start - milliseconds(ageMs), [this, name] { fired.push_back(name); });
+	}
+
+	TaskId addTask(Clock::time_point when, milliseconds timeout) {
+		Task task(std::vector<PacketPtr>(), 0, udp::endpoint());
+		task.nextLaunch = when;
+		task.timeout = timeout;
+		return taskman.add(std::move(task));
+	}
+
+	void run() {
+		taskman.run([] (const Task&) { });
+	}
+};
+
+TEST_F(TaskManagerTest, Empty)
+{
+	EXPECT_TRUE(taskman.empty());
+	EXPECT_EQ(taskman.nextTime(), Clock::time_point::max());
+	run();
+}
+
+TEST_F(TaskManagerTest, FiresInTimeOrder)
+{
+	const int ages[] = { 5, 90, 30, 70, 10, 50, 80, 20, 60, 40 };
+	for (int age : ages)
+		addTimer(age, age);
+
+	EXPECT_EQ(taskman.nextTime(), start - milliseconds(90));
+
+	run();
+	EXPECT_EQ(fired, (std::vector<int>{ 90, 80, 70, 60, 50, 40, 30, 20, 10, 5 }));
+	EXPECT_TRUE(taskman.empty());
+}
+
+TEST_F(TaskManagerTest, FutureEntriesWait)
+{
+	addTimer(1, 10);
+	taskman.addTimer(start + milliseconds(500), [this] { fired.push_back(2); });
+
+	run();
+	EXPECT_EQ(fired, (std::vector<int>{ 1 }));
+	EXPECT_FALSE(taskman.empty());
+	EXPECT_EQ(taskman.nextTime(), start + milliseconds(500));
+}
+
+TEST_F(TaskManagerTest, RemoveMiddle)
+{
+	std::vector<TaskId> ids;
+	for (int age = 10; age <= 70; age += 10)
+		ids.push_back(addTimer(age, age));
+
+	// An entry from the inside of the heap, then the one on top
+	taskman.remove(ids[3]);
+	taskman.remove(ids[6]);
+	EXPECT_EQ(taskman.nextTime(), start - milliseconds(60));
+
+	// Removing twice does nothing
+	taskman.remove(ids[3]);
+
+	run();
+	EXPECT_EQ(fired, (std::vector<int>{ 60, 50, 30, 20, 10 }));
+}
+
+TEST_F(TaskManagerTest, StaleHandle)
+{
+	const TaskId first = addTask(start + milliseconds(500), milliseconds(1));
+	taskman.remove(first);
+	EXPECT_TRUE(taskman.empty());
+
+	// The slot is reused by the next entry, with a new generation
+	const TaskId second = addTask(start + milliseconds(500), milliseconds(1));
+	EXPECT_EQ(second.slot, first.slot);
+	EXPECT_NE(second.generation, first.generation);
+
+	EXPECT_FALSE(taskman.update(first, [] (Task&) { ADD_FAILURE(); }));
+	taskman.remove(first);
+	EXPECT_FALSE(taskman.empty());
+
+	EXPECT_TRUE(taskman.update(second, [] (Task& task) { EXPECT_EQ(task.launches, 0u); }));
+	taskman.remove(second);
+	EXPECT_TRUE(taskman.empty());
+}
+
+TEST_F(TaskManagerTest, ClearKeepsTimers)
+{
+	addTask(start - milliseconds(10), milliseconds(1));
+	addTimer(1, 5);
+	addTask(start - milliseconds(1), milliseconds(1));
+
+	taskman.clear();
+	EXPECT_FALSE(taskman.empty());
+
+	size_t launched = 0;
+	taskman.run([&launched] (const Task&) { ++launched; });
+	EXPECT_EQ(launched, 0u);
+	EXPECT_EQ(fired, (std::vector<int>{ 1 }));
+}
+
+TEST_F(TaskManagerTest, TasksStayScheduled)
+{
+	const TaskId due = addTask(start - milliseconds(1), milliseconds(200));
+	addTask(start + milliseconds(500), milliseconds(1));
+
+	size_t launched = 0;
+	taskman.run([&launched] (const Task&) { ++launched; });
+	EXPECT_EQ(launched, 1u);
+
+	// The launched task moved on by its timeout, still ahead of the other one
+	const Clock::time_point next = start + milliseconds(199);
+	EXPECT_TRUE(taskman.update(due, [next] (Task& task) {
+		EXPECT_EQ(task.launches, 1u);
+		EXPECT_EQ(task.nextLaunch, next);
+		EXPECT_EQ(task.timeout, milliseconds(400));
+	}));
+	EXPECT_EQ(taskman.nextTime(), next);
+}
+
+TEST_F(TaskManagerTest, TimersAddEntriesDuringRun)
+{
+	taskman.addTimer(start - milliseconds(30), [this] {
+		fired.push_back(1);
+
+		// Already due, so the same run fires it
+		taskman.addTimer(start - milliseconds(20), [this] { fired.push_back(2); });
+
+		// Due later, it waits for the next run
+		taskman.addTimer(Clock::now() + milliseconds(500), [this] { fired.push_back(3); });
+
+		// A task added by a timer is launched in order with the rest
+		addTask(start - milliseconds(15), milliseconds(200));
+	});
+	addTimer(4, 10);
+
+	taskman.run([this] (const Task&) { fired.push_back(0); });
+
+	EXPECT_EQ(fired, (std::vector<int>{ 1, 2, 0, 4 }));
+	EXPECT_FALSE(taskman.empty());
+}
+
+TEST_F(TaskManagerTest, TimerRemovesEntryDuringRun)
+{
+	TaskId later;
+	addTimer(1, 20);
+	taskman.addTimer(start - milliseconds(15), [this, &later] {
+		fired.push_back(2);
+		taskman.remove(later);
+	});
+	later = addTimer(3, 10);
+
+	run();
+	EXPECT_EQ(fired, (std::vector<int>{ 1, 2 }));
+	EXPECT_TRUE(taskman.empty());
+}
@@ -180,6 +180,26 @@ struct NodesInfoGetResult
     3: NodesHashes nodesHashes
 }
 
+// NetworkStatsGet
+
+struct PeerRtt
+{
+    1: string address
+    2: i64 srttUs
+    3: i64 rttVarUs
+    4: i64 rtoUs
+    5: i64 samples
+}
+
+typedef list<PeerRtt> PeersRtt
+
+struct NetworkStatsGetResult
+{
+    1: APIResponse status
+    2: PeerRtt network
+    3: PeersRtt peers
+}
+
 // SmartContractGetResult
 
 struct SmartContractGetResult
@@ -220,6 +240,7 @@ service API
 
     StatsGetResult StatsGet()
     NodesInfoGetResult NodesInfoGet()
+    NetworkStatsGetResult NetworkStatsGet()
 
     SmartContractGetResult SmartContractGet(1:Address address)
     SmartContractsListGetResult SmartContractsListGet(1:Address deployer)